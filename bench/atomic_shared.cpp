@@ -0,0 +1,58 @@
+#include "bench.h"
+
+#include <shared-from-this/atomic_shared.h>
+
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+// Reader throughput of a published `SharedPtr<const T>` slot: `AtomicSharedPtr` against a slot
+// guarded by a mutex. One writer replaces the value every 100us while the readers run.
+
+namespace {
+
+using Table = std::vector<int>;
+
+constexpr auto kDuration = std::chrono::milliseconds(300);
+constexpr auto kWritePeriod = std::chrono::microseconds(100);
+
+class MutexSlot {
+public:
+    SharedPtr<const Table> Load() const {
+        std::lock_guard guard(mutex_);
+        return value_;
+    }
+
+    void Store(SharedPtr<const Table> value) {
+        std::lock_guard guard(mutex_);
+        value_ = std::move(value);
+    }
+
+private:
+    mutable std::mutex mutex_;
+    SharedPtr<const Table> value_;
+};
+
+template <typename Slot>
+double ReadsPerSecond(int readers) {
+    Slot slot;
+    slot.Store(MakeShared<const Table>(64, 1));
+    uint64_t reads = RunThreads(
+        readers, kDuration, [&slot](int) { DoNotOptimize(slot.Load()->front()); },
+        [&slot] {
+            slot.Store(MakeShared<const Table>(64, 2));
+            std::this_thread::sleep_for(kWritePeriod);
+        });
+    return reads / std::chrono::duration<double>(kDuration).count();
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%8s %18s %18s\n", "readers", "atomic Mreads/s", "mutex Mreads/s");
+    for (int readers : ThreadCounts()) {
+        double atomic = ReadsPerSecond<AtomicSharedPtr<const Table>>(readers);
+        double mutex = ReadsPerSecond<MutexSlot>(readers);
+        std::printf("%8d %18.2f %18.2f\n", readers, atomic / 1e6, mutex / 1e6);
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Helpers shared by the micro-benchmarks in this directory.
+
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+using BenchClock = std::chrono::steady_clock;
+
+// Runs `body(thread_index)` in a loop on `threads` threads for `duration` and returns the total
+// number of iterations done. `background` (if any) runs on one more thread until the readers stop.
+template <typename Body, typename Background>
+uint64_t RunThreads(int threads, std::chrono::milliseconds duration, Body body,
+                    Background background) {
+    std::atomic<bool> stop = false;
+    std::atomic<uint64_t> total = 0;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&stop, &total, &body, i] {
+            uint64_t done = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                body(i);
+                ++done;
+            }
+            total += done;
+        });
+    }
+    std::thread helper([&stop, &background] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            background();
+        }
+    });
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    helper.join();
+    return total;
+}
+
+template <typename Body>
+uint64_t RunThreads(int threads, std::chrono::milliseconds duration, Body body) {
+    return RunThreads(threads, duration, body, [] { std::this_thread::yield(); });
+}
+
+// Thread counts to try: powers of two up to the number of hardware threads.
+inline std::vector<int> ThreadCounts() {
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(max_threads);
+    return counts;
+}
+
+// Nanoseconds per operation of `round()`, which does `ops` operations: the best of a few rounds, so
+// a descheduled round does not skew the result. `setup()` runs untimed before every round.
+template <typename Setup, typename Round>
+double NanosPerOp(size_t ops, Setup setup, Round round) {
+    constexpr int kRounds = 7;
+    setup();
+    round();
+    double best = 0;
+    for (int i = 0; i < kRounds; ++i) {
+        setup();
+        auto start = BenchClock::now();
+        round();
+        double nanos = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+        if (i == 0 || nanos < best) {
+            best = nanos;
+        }
+    }
+    return best / ops;
+}
+
+template <typename Round>
+double NanosPerOp(size_t ops, Round round) {
+    return NanosPerOp(ops, [] {}, round);
+}
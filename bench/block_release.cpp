@@ -0,0 +1,43 @@
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Size of the common control blocks, and the cost of creating a pointer and dropping its last
+// reference, which is where the block is asked to destroy the object and free itself.
+
+namespace {
+
+constexpr size_t kOps = 1 << 16;
+
+template <typename Make>
+double NanosPerPointer(Make make) {
+    std::vector<decltype(make())> pointers(kOps);
+    return NanosPerOp(kOps, [&] {
+        for (auto& pointer : pointers) {
+            pointer = make();
+        }
+        pointers.assign(kOps, nullptr);
+    });
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%-36s %6zu\n", "sizeof(PointerBlock<int>)", sizeof(PointerBlock<int>));
+    std::printf("%-36s %6zu\n", "sizeof(HolderBlock<int>)", sizeof(HolderBlock<int>));
+    std::printf("%-36s %6zu\n", "sizeof(HolderBlock<void*>)", sizeof(HolderBlock<void*>));
+    std::printf("%-36s %6zu\n", "sizeof(HolderBlock<std::string>)",
+                sizeof(HolderBlock<std::string>));
+
+    std::printf("\n%-36s %12s\n", "create + release", "ns/op");
+    std::printf("%-36s %12.2f\n", "MakeShared<int>",
+                NanosPerPointer([] { return MakeShared<int>(1); }));
+    std::printf("%-36s %12.2f\n", "MakeShared<std::string>",
+                NanosPerPointer([] { return MakeShared<std::string>("value"); }));
+    std::printf("%-36s %12.2f\n", "SharedPtr<int>(new int)",
+                NanosPerPointer([] { return SharedPtr<int>(new int(1)); }));
+}
@@ -0,0 +1,49 @@
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+#include <unique/unique.h>
+
+#include <cstdio>
+#include <cstring>
+
+// Allocating a scratch buffer and filling it once: value-initialized (`MakeShared<char[]>`, zeroed
+// first) against default-initialized (`MakeSharedForOverwrite<char[]>`), for `SharedPtr` and
+// `UniquePtr`. The difference is one write pass over the buffer.
+
+namespace {
+
+constexpr size_t kMinSize = size_t{64} << 10;
+constexpr size_t kMaxSize = size_t{4} << 20;
+constexpr size_t kBytesPerRound = size_t{256} << 20;
+
+// Gigabytes of buffer handed out per second when every buffer is filled with `fill` once.
+template <typename Make>
+double GigabytesPerSecond(size_t size, Make make) {
+    size_t buffers = std::max<size_t>(1, kBytesPerRound / size);
+    double nanos = NanosPerOp(buffers, [&] {
+        for (size_t i = 0; i < buffers; ++i) {
+            auto buffer = make(size);
+            std::memset(&buffer[0], static_cast<int>(i), size);
+            DoNotOptimize(buffer[size - 1]);
+        }
+    });
+    return size / nanos;
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%10s %14s %14s %14s %14s\n", "size KB", "shared GB/s", "overwrite GB/s",
+                "unique GB/s", "overwrite GB/s");
+    for (size_t size = kMinSize; size <= kMaxSize; size *= 4) {
+        double shared = GigabytesPerSecond(size, [](size_t n) { return MakeShared<char[]>(n); });
+        double shared_overwrite = GigabytesPerSecond(
+            size, [](size_t n) { return MakeSharedForOverwrite<char[]>(n); });
+        double unique = GigabytesPerSecond(
+            size, [](size_t n) { return UniquePtr<char[]>(new char[n]()); });
+        double unique_overwrite = GigabytesPerSecond(
+            size, [](size_t n) { return MakeUniqueForOverwrite<char[]>(n); });
+        std::printf("%10zu %14.2f %14.2f %14.2f %14.2f\n", size >> 10, shared, shared_overwrite,
+                    unique, unique_overwrite);
+    }
+}
@@ -0,0 +1,56 @@
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+
+#include <cstdio>
+#include <vector>
+
+// Reader throughput on one hot object: every reader copying the same `SharedPtr` (all of them
+// bumping one counter) against readers protecting the raw pointer with a `HazardPointer`. In the
+// hazard variant a writer also replaces the object every 100us, retiring the old one.
+
+namespace {
+
+using Table = std::vector<int>;
+
+constexpr auto kDuration = std::chrono::milliseconds(300);
+constexpr auto kWritePeriod = std::chrono::microseconds(100);
+
+double CopiesPerSecond(int readers) {
+    const SharedPtr<const Table> table = MakeShared<const Table>(64, 1);
+    uint64_t reads = RunThreads(readers, kDuration, [&table](int) {
+        SharedPtr<const Table> copy = table;
+        DoNotOptimize(copy->front());
+    });
+    return reads / std::chrono::duration<double>(kDuration).count();
+}
+
+double ProtectsPerSecond(int readers) {
+    SharedPtr<const Table> table = MakeShared<const Table>(HazardReclamationTag{}, 64, 1);
+    std::atomic<const Table*> source = table.Get();
+    std::vector<HazardPointer> hazards(readers);
+    uint64_t reads = RunThreads(
+        readers, kDuration,
+        [&source, &hazards](int i) {
+            const Table* read = hazards[i].Protect(source);
+            DoNotOptimize(read->front());
+        },
+        [&table, &source] {
+            SharedPtr<const Table> next = MakeShared<const Table>(HazardReclamationTag{}, 64, 2);
+            source.store(next.Get());
+            table = std::move(next);
+            std::this_thread::sleep_for(kWritePeriod);
+        });
+    return reads / std::chrono::duration<double>(kDuration).count();
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%8s %18s %18s\n", "readers", "copy Mreads/s", "hazard Mreads/s");
+    for (int readers : ThreadCounts()) {
+        double copy = CopiesPerSecond(readers);
+        double hazard = ProtectsPerSecond(readers);
+        std::printf("%8d %18.2f %18.2f\n", readers, copy / 1e6, hazard / 1e6);
+    }
+}
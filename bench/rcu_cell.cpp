@@ -0,0 +1,51 @@
+#include "bench.h"
+
+#include <shared-from-this/atomic_shared.h>
+#include <shared-from-this/rcu_cell.h>
+
+#include <cstdio>
+#include <vector>
+
+// Reader throughput of a read-mostly table: `RcuCell::Read` (epoch pin, no reference count touched)
+// against `AtomicSharedPtr::Load` (a counted copy per read). One writer publishes a new table every
+// 100us while the readers run.
+
+namespace {
+
+using Table = std::vector<int>;
+
+constexpr auto kDuration = std::chrono::milliseconds(300);
+constexpr auto kWritePeriod = std::chrono::microseconds(100);
+
+double RcuReadsPerSecond(int readers) {
+    RcuCell<Table> cell(64, 1);
+    uint64_t reads = RunThreads(
+        readers, kDuration, [&cell](int) { DoNotOptimize(cell.Read()->front()); },
+        [&cell] {
+            cell.Publish(64, 2);
+            std::this_thread::sleep_for(kWritePeriod);
+        });
+    return reads / std::chrono::duration<double>(kDuration).count();
+}
+
+double AtomicReadsPerSecond(int readers) {
+    AtomicSharedPtr<const Table> slot(MakeShared<const Table>(64, 1));
+    uint64_t reads = RunThreads(
+        readers, kDuration, [&slot](int) { DoNotOptimize(slot.Load()->front()); },
+        [&slot] {
+            slot.Store(MakeShared<const Table>(64, 2));
+            std::this_thread::sleep_for(kWritePeriod);
+        });
+    return reads / std::chrono::duration<double>(kDuration).count();
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%8s %18s %18s\n", "readers", "rcu Mreads/s", "atomic Mreads/s");
+    for (int readers : ThreadCounts()) {
+        double rcu = RcuReadsPerSecond(readers);
+        double atomic = AtomicReadsPerSecond(readers);
+        std::printf("%8d %18.2f %18.2f\n", readers, rcu / 1e6, atomic / 1e6);
+    }
+}
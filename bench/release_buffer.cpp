@@ -0,0 +1,48 @@
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+
+#include <cstdio>
+#include <vector>
+
+// Clearing a batch of `SharedPtr`s to a few objects which other threads keep copying: releasing
+// every pointer on the spot against releasing them through a `ReleaseBuffer`.
+
+namespace {
+
+constexpr int kObjects = 16;
+constexpr int kBatch = 4096;
+constexpr auto kDuration = std::chrono::milliseconds(300);
+
+template <bool kBuffered>
+double BatchesPerSecond(const std::vector<SharedPtr<int>>& objects, int threads) {
+    uint64_t batches = RunThreads(threads, kDuration, [&objects](int) {
+        std::vector<SharedPtr<int>> batch;
+        batch.reserve(kBatch);
+        for (int i = 0; i < kBatch; ++i) {
+            batch.push_back(objects[i % kObjects]);
+        }
+        if constexpr (kBuffered) {
+            ReleaseBuffer buffer;
+            batch.clear();
+        } else {
+            batch.clear();
+        }
+    });
+    return batches / std::chrono::duration<double>(kDuration).count();
+}
+
+}  // namespace
+
+int main() {
+    std::vector<SharedPtr<int>> objects;
+    for (int i = 0; i < kObjects; ++i) {
+        objects.push_back(MakeShared<int>(i));
+    }
+    std::printf("%8s %18s %18s\n", "threads", "plain Kbatch/s", "buffered Kbatch/s");
+    for (int threads : ThreadCounts()) {
+        double plain = BatchesPerSecond<false>(objects, threads);
+        double buffered = BatchesPerSecond<true>(objects, threads);
+        std::printf("%8d %18.2f %18.2f\n", threads, plain / 1e3, buffered / 1e3);
+    }
+}
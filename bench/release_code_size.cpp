@@ -0,0 +1,98 @@
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+#include <shared-from-this/weak.h>
+
+#include <elf.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Machine code each pointer type inlines into a function that drops it, read from the symbol table
+// of this binary, and the time the drop takes when it is not the last reference. Every probe below
+// is a separate function, so its size is roughly what the release path costs at each call site.
+// Needs an unstripped ELF binary (Linux).
+
+extern "C" {
+
+[[gnu::noinline]] void ProbeDropShared(SharedPtr<int>* ptr) {
+    ptr->~SharedPtr();
+}
+
+[[gnu::noinline]] void ProbeResetShared(SharedPtr<int>* ptr) {
+    ptr->Reset();
+}
+
+[[gnu::noinline]] void ProbeDropSharedArray(SharedPtr<int[]>* ptr) {
+    ptr->~SharedPtr();
+}
+
+[[gnu::noinline]] void ProbeDropWeak(WeakPtr<int>* ptr) {
+    ptr->~WeakPtr();
+}
+
+[[gnu::noinline]] void ProbeAssignShared(SharedPtr<int>* ptr, const SharedPtr<int>* other) {
+    *ptr = *other;
+}
+}
+
+namespace {
+
+constexpr size_t kOps = 1 << 20;
+
+// Size of the function symbol `name` in `/proc/self/exe`, or 0 if it is not there.
+size_t SymbolSize(const std::vector<char>& image, const char* name) {
+    if (image.size() < sizeof(Elf64_Ehdr)) {
+        return 0;
+    }
+    const auto* header = reinterpret_cast<const Elf64_Ehdr*>(image.data());
+    const auto* sections = reinterpret_cast<const Elf64_Shdr*>(image.data() + header->e_shoff);
+    for (size_t i = 0; i < header->e_shnum; ++i) {
+        if (sections[i].sh_type != SHT_SYMTAB) {
+            continue;
+        }
+        const Elf64_Shdr& table = sections[i];
+        const auto* symbols = reinterpret_cast<const Elf64_Sym*>(image.data() + table.sh_offset);
+        const char* names = image.data() + sections[table.sh_link].sh_offset;
+        for (size_t j = 0; j < table.sh_size / sizeof(Elf64_Sym); ++j) {
+            if (std::strcmp(names + symbols[j].st_name, name) == 0) {
+                return symbols[j].st_size;
+            }
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main() {
+    std::ifstream file("/proc/self/exe", std::ios::binary);
+    std::vector<char> image((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+
+    std::printf("%-36s %8s\n", "function", "bytes");
+    for (const char* name : {"ProbeDropShared", "ProbeResetShared", "ProbeDropSharedArray",
+                             "ProbeDropWeak", "ProbeAssignShared"}) {
+        std::printf("%-36s %8zu\n", name, SymbolSize(image, name));
+    }
+
+    auto shared = MakeShared<int>(1);
+    WeakPtr<int> weak(shared);
+    std::printf("\n%-36s %8s\n", "copy + drop, not the last", "ns/op");
+    std::printf("%-36s %8.2f\n", "SharedPtr<int>", NanosPerOp(kOps, [&] {
+                    for (size_t i = 0; i < kOps; ++i) {
+                        SharedPtr<int> copy(shared);
+                        DoNotOptimize(copy);
+                    }
+                }));
+    std::printf("%-36s %8.2f\n", "WeakPtr<int>", NanosPerOp(kOps, [&] {
+                    for (size_t i = 0; i < kOps; ++i) {
+                        WeakPtr<int> copy(weak);
+                        DoNotOptimize(copy);
+                    }
+                }));
+}
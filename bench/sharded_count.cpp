@@ -0,0 +1,37 @@
+#include "bench.h"
+
+#include <shared-from-this/shared.h>
+
+#include <cstdio>
+
+// Copy throughput of one hot object copied and released by every thread: the plain block (one
+// shared counter) against a block made with `ShardedCountingTag`.
+
+namespace {
+
+struct Logger {
+    int level = 0;
+};
+
+constexpr auto kDuration = std::chrono::milliseconds(300);
+
+double CopiesPerSecond(const SharedPtr<Logger>& logger, int threads) {
+    uint64_t copies = RunThreads(threads, kDuration, [&logger](int) {
+        SharedPtr<Logger> copy = logger;
+        DoNotOptimize(copy->level);
+    });
+    return copies / std::chrono::duration<double>(kDuration).count();
+}
+
+}  // namespace
+
+int main() {
+    auto plain = MakeShared<Logger>();
+    auto sharded = MakeShared<Logger>(ShardedCountingTag{});
+    std::printf("%8s %18s %18s\n", "threads", "plain Mcopies/s", "sharded Mcopies/s");
+    for (int threads : ThreadCounts()) {
+        double plain_rate = CopiesPerSecond(plain, threads);
+        double sharded_rate = CopiesPerSecond(sharded, threads);
+        std::printf("%8d %18.2f %18.2f\n", threads, plain_rate / 1e6, sharded_rate / 1e6);
+    }
+}
@@ -0,0 +1,174 @@
+#include "bench.h"
+
+#include <intrusive/intrusive.h>
+#include <shared-from-this/shared.h>
+#include <shared-from-this/weak.h>
+#include <unique/unique.h>
+
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Single-threaded hot paths of every pointer in the repo next to its `std::` counterpart. Prints
+// one JSON object, {"unit": "ns/op", "results": [{"name", "ours", "std"}, ...]}, to diff runs.
+// `IntrusivePtr` has no standard counterpart and is compared with `std::shared_ptr`.
+
+namespace {
+
+constexpr size_t kOps = 1 << 16;
+
+struct Payload {
+    int first = 1;
+    int second = 2;
+};
+
+struct IntrusivePayload : ThreadSafeRefCounted<IntrusivePayload> {
+    int first = 1;
+    int second = 2;
+};
+
+struct Result {
+    const char* name;
+    double ours;
+    double std;
+};
+
+// Filling a vector with `make()` and clearing it, timed separately.
+template <typename Make>
+std::pair<double, double> ConstructDestroy(Make make) {
+    using Ptr = decltype(make());
+    std::vector<Ptr> ptrs;
+    ptrs.reserve(kOps);
+    auto fill = [&] {
+        for (size_t j = 0; j < kOps; ++j) {
+            ptrs.push_back(make());
+        }
+    };
+    auto clear = [&] { ptrs.clear(); };
+    double construct = 0;
+    double destroy = 0;
+    for (int i = 0; i < 3; ++i) {
+        double built = NanosPerOp(kOps, clear, fill);
+        double dropped = NanosPerOp(kOps, fill, clear);
+        construct = i == 0 ? built : std::min(construct, built);
+        destroy = i == 0 ? dropped : std::min(destroy, dropped);
+    }
+    ptrs.clear();
+    return {construct, destroy};
+}
+
+template <typename Ptr>
+double Copy(const Ptr& source) {
+    return NanosPerOp(kOps, [&source] {
+        for (size_t i = 0; i < kOps; ++i) {
+            Ptr copy = source;
+            DoNotOptimize(copy);
+        }
+    });
+}
+
+template <typename Ptr>
+double Move(Ptr first) {
+    Ptr second;
+    return NanosPerOp(2 * kOps, [&first, &second] {
+        for (size_t i = 0; i < kOps; ++i) {
+            second = std::move(first);
+            first = std::move(second);
+            DoNotOptimize(first);
+        }
+    });
+}
+
+template <typename Make>
+double MakeAndDrop(Make make) {
+    return NanosPerOp(kOps, [&make] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto ptr = make();
+            DoNotOptimize(ptr);
+        }
+    });
+}
+
+template <typename Weak>
+double Lock(const Weak& weak) {
+    return NanosPerOp(kOps, [&weak] {
+        for (size_t i = 0; i < kOps; ++i) {
+            auto locked = weak.lock();
+            DoNotOptimize(locked);
+        }
+    });
+}
+
+// Our `WeakPtr` spells it `Lock`.
+struct LockAdapter {
+    SharedPtr<Payload> lock() const {
+        return weak.Lock();
+    }
+
+    WeakPtr<Payload> weak;
+};
+
+}  // namespace
+
+int main() {
+    // libstdc++ switches `std::shared_ptr` to plain counters until the process starts a thread.
+    std::thread([] {}).join();
+
+    std::vector<Result> results;
+
+    auto [shared_construct, shared_destroy] =
+        ConstructDestroy([] { return SharedPtr<Payload>(new Payload()); });
+    auto [std_shared_construct, std_shared_destroy] =
+        ConstructDestroy([] { return std::shared_ptr<Payload>(new Payload()); });
+    results.push_back({"shared_construct", shared_construct, std_shared_construct});
+    results.push_back({"shared_destroy", shared_destroy, std_shared_destroy});
+
+    auto [unique_construct, unique_destroy] =
+        ConstructDestroy([] { return UniquePtr<Payload>(new Payload()); });
+    auto [std_unique_construct, std_unique_destroy] =
+        ConstructDestroy([] { return std::unique_ptr<Payload>(new Payload()); });
+    results.push_back({"unique_construct", unique_construct, std_unique_construct});
+    results.push_back({"unique_destroy", unique_destroy, std_unique_destroy});
+
+    auto [intrusive_construct, intrusive_destroy] =
+        ConstructDestroy([] { return IntrusivePtr<IntrusivePayload>(new IntrusivePayload()); });
+    results.push_back({"intrusive_construct", intrusive_construct, std_shared_construct});
+    results.push_back({"intrusive_destroy", intrusive_destroy, std_shared_destroy});
+
+    auto shared = MakeShared<Payload>();
+    auto std_shared = std::make_shared<Payload>();
+    auto intrusive = MakeIntrusive<IntrusivePayload>();
+    results.push_back({"shared_copy", Copy(shared), Copy(std_shared)});
+    results.push_back({"intrusive_copy", Copy(intrusive), Copy(std_shared)});
+
+    results.push_back({"shared_move", Move(shared), Move(std_shared)});
+    results.push_back({"intrusive_move", Move(intrusive), Move(std_shared)});
+    results.push_back({"unique_move", Move(UniquePtr<Payload>(new Payload())),
+                       Move(std::make_unique<Payload>())});
+
+    results.push_back({"make_shared", MakeAndDrop([] { return MakeShared<Payload>(); }),
+                       MakeAndDrop([] { return std::make_shared<Payload>(); })});
+    results.push_back({"make_intrusive",
+                       MakeAndDrop([] { return MakeIntrusive<IntrusivePayload>(); }),
+                       MakeAndDrop([] { return std::make_shared<Payload>(); })});
+
+    results.push_back({"weak_lock", Lock(LockAdapter{shared}),
+                       Lock(std::weak_ptr<Payload>(std_shared))});
+    results.push_back({"weak_lock_expired", Lock(LockAdapter{MakeShared<Payload>()}),
+                       Lock(std::weak_ptr<Payload>(std::make_shared<Payload>()))});
+
+    results.push_back({"aliasing", MakeAndDrop([&shared] {
+                           return SharedPtr<int>(shared, &shared->second);
+                       }),
+                       MakeAndDrop([&std_shared] {
+                           return std::shared_ptr<int>(std_shared, &std_shared->second);
+                       })});
+
+    std::printf("{\"unit\": \"ns/op\", \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::printf("  {\"name\": \"%s\", \"ours\": %.3f, \"std\": %.3f}%s\n", results[i].name,
+                    results[i].ours, results[i].std, i + 1 == results.size() ? "" : ",");
+    }
+    std::printf("]}\n");
+}
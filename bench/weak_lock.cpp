@@ -0,0 +1,78 @@
+#include "bench.h"
+
+#include <shared-from-this/weak.h>
+
+#include <cstdio>
+#include <vector>
+
+// Cache workload for `WeakPtr::Lock`: readers upgrade random weak handles while a writer drops the
+// last strong reference of one entry after another, so more and more upgrades race with (or come
+// after) the final release.
+
+namespace {
+
+struct Entry {
+    char payload[48] = {};
+};
+
+constexpr size_t kEntries = 1 << 20;
+constexpr auto kDuration = std::chrono::milliseconds(300);
+// Roughly half of the entries are gone by the end of a run.
+constexpr size_t kDropBatch = 128;
+constexpr auto kDropPeriod = std::chrono::microseconds(100);
+
+struct Result {
+    double locks_per_second;
+    double hit_ratio;
+};
+
+Result Run(int readers) {
+    std::vector<SharedPtr<Entry>> strong;
+    std::vector<WeakPtr<Entry>> weak;
+    strong.reserve(kEntries);
+    weak.reserve(kEntries);
+    for (size_t i = 0; i < kEntries; ++i) {
+        strong.push_back(MakeShared<Entry>());
+        weak.emplace_back(strong.back());
+    }
+
+    std::vector<uint64_t> hits(readers * 8);
+    size_t dropped = 0;
+    uint64_t locks = RunThreads(
+        readers, kDuration,
+        [&weak, &hits](int reader) {
+            thread_local uint64_t state = 88172645463325252ull + reader;
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            SharedPtr<Entry> locked;
+            if (weak[state % kEntries].TryLock(locked)) {
+                DoNotOptimize(locked->payload[0]);
+                ++hits[reader * 8];
+            }
+        },
+        [&strong, &dropped] {
+            for (size_t i = 0; i < kDropBatch && dropped < kEntries; ++i, ++dropped) {
+                strong[(dropped * 7919) % kEntries].Reset();
+            }
+            std::this_thread::sleep_for(kDropPeriod);
+        });
+
+    uint64_t total_hits = 0;
+    for (int i = 0; i < readers; ++i) {
+        total_hits += hits[i * 8];
+    }
+    return {locks / std::chrono::duration<double>(kDuration).count(),
+            locks == 0 ? 0 : static_cast<double>(total_hits) / locks};
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%8s %16s %10s\n", "readers", "Mlocks/s", "hit ratio");
+    for (int readers : ThreadCounts()) {
+        Result result = Run(readers);
+        std::printf("%8d %16.2f %10.3f\n", readers, result.locks_per_second / 1e6,
+                    result.hit_ratio);
+    }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Bump allocator for object graphs that die together, e.g. everything built while serving one
+// request. Objects made by `MakeSharedIn`, `MakeIntrusiveIn` and `MakeUniqueIn` are still destroyed
+// when their last owner goes away, but their memory is only reclaimed by `Reset()` or the arena's
+// destructor, so nothing is freed one object at a time.
+//
+// Allocation is not thread-safe; objects may be released on any thread. Nothing allocated from the
+// arena may be alive when it is reset or destroyed.
+class Arena {
+public:
+    struct Options {
+        size_t chunk_size = size_t{1} << 20;
+        // Back chunks with transparent huge pages where the system supports it.
+        bool huge_pages = false;
+        // Touch every page of a chunk up front, so the first objects do not take page faults.
+        bool prefault = false;
+    };
+
+    static constexpr size_t kPageSize = 4096;
+    static constexpr size_t kHugePageSize = size_t{2} << 20;
+
+    Arena() : Arena(Options()) {
+    }
+
+    explicit Arena(Options options) : options_(options) {
+        size_t page = options_.huge_pages ? kHugePageSize : kPageSize;
+        options_.chunk_size = RoundUp(options_.chunk_size, page);
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        for (const Chunk& chunk : chunks_) {
+            std::free(chunk.memory);
+        }
+    }
+
+    // `align` must be a power of two no larger than `kPageSize`.
+    void* Allocate(size_t size, size_t align) {
+        size_t offset = RoundUp(offset_, align);
+        if (current_ == chunks_.size() || offset + size > chunks_[current_].size) [[unlikely]] {
+            return AllocateSlow(size);
+        }
+        offset_ = offset + size;
+        return chunks_[current_].memory + offset;
+    }
+
+    // Makes all memory available again. Chunks of the regular size are kept, so a reused arena
+    // neither allocates nor faults.
+    void Reset() {
+        size_t kept = 0;
+        for (const Chunk& chunk : chunks_) {
+            if (chunk.size == options_.chunk_size) {
+                chunks_[kept++] = chunk;
+            } else {
+                std::free(chunk.memory);
+            }
+        }
+        chunks_.resize(kept);
+        current_ = 0;
+        offset_ = 0;
+    }
+
+    // Bytes reserved from the system.
+    size_t Capacity() const {
+        size_t capacity = 0;
+        for (const Chunk& chunk : chunks_) {
+            capacity += chunk.size;
+        }
+        return capacity;
+    }
+
+private:
+    struct Chunk {
+        std::byte* memory;
+        size_t size;
+    };
+
+    static size_t RoundUp(size_t value, size_t align) {
+        return (value + align - 1) / align * align;
+    }
+
+    [[gnu::noinline]] void* AllocateSlow(size_t size) {
+        // Move on to a kept chunk after `Reset()`, if it fits.
+        while (current_ + 1 < chunks_.size()) {
+            ++current_;
+            offset_ = 0;
+            if (size <= chunks_[current_].size) {
+                offset_ = size;
+                return chunks_[current_].memory;
+            }
+        }
+        // Oversized requests get a chunk of their own.
+        Chunk chunk = NewChunk(std::max(options_.chunk_size, size));
+        chunks_.push_back(chunk);
+        current_ = chunks_.size() - 1;
+        offset_ = size;
+        return chunk.memory;
+    }
+
+    Chunk NewChunk(size_t size) {
+        size_t align = options_.huge_pages ? kHugePageSize : kPageSize;
+        size = RoundUp(size, align);
+        std::byte* memory = static_cast<std::byte*>(std::aligned_alloc(align, size));
+        if (memory == nullptr) {
+            throw std::bad_alloc();
+        }
+#ifdef MADV_HUGEPAGE
+        if (options_.huge_pages) {
+            // Only a hint: without THP the chunk is still usable.
+            madvise(memory, size, MADV_HUGEPAGE);
+        }
+#endif
+        if (options_.prefault) {
+            for (size_t offset = 0; offset < size; offset += kPageSize) {
+                static_cast<volatile std::byte*>(memory)[offset] = std::byte{0};
+            }
+        }
+        return {memory, size};
+    }
+
+    Options options_;
+    std::vector<Chunk> chunks_;
+    // `chunks_[current_]` is being filled from `offset_` on.
+    size_t current_ = 0;
+    size_t offset_ = 0;
+};
+
+// Deleter for `UniquePtr`s from `MakeUniqueIn`: runs the destructor, the arena keeps the memory.
+struct ArenaDelete {
+    template <typename T>
+    void operator()(T* object) const {
+        if (object != nullptr) {
+            object->~T();
+        }
+    }
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Size-class pool for small, short-lived allocations such as control blocks.
+//
+// Sizes up to `kMaxSize` are rounded up to a multiple of `kGranularity`; every class has its own
+// free list. Each thread caches free blocks per class and moves them to and from the shared lists
+// `kBatch` at a time, so most allocations are a pop off a thread-local list. Blocks may be freed on
+// any thread. Memory is carved out of slabs that are never returned to the system.
+class BlockPool {
+public:
+    static constexpr size_t kGranularity = 16;
+    static constexpr size_t kClasses = 8;
+    static constexpr size_t kMaxSize = kGranularity * kClasses;
+    static constexpr size_t kBatch = 64;
+
+    static void* Allocate(size_t size) {
+        if (size > kMaxSize) {
+            return ::operator new(size);
+        }
+        size_t index = ClassOf(size);
+        if (local.dead) [[unlikely]] {
+            return Central().Pop(index);
+        }
+        if (local.heads[index] == nullptr) [[unlikely]] {
+            Refill(index);
+        }
+        FreeNode* node = local.heads[index];
+        local.heads[index] = node->next;
+        --local.counts[index];
+        return node;
+    }
+
+    static void Deallocate(void* ptr, size_t size) {
+        if (size > kMaxSize) {
+            ::operator delete(ptr);
+            return;
+        }
+        size_t index = ClassOf(size);
+        FreeNode* node = static_cast<FreeNode*>(ptr);
+        if (local.dead) [[unlikely]] {
+            node->next = nullptr;
+            Central().Push(index, node, node);
+            return;
+        }
+        node->next = local.heads[index];
+        local.heads[index] = node;
+        if (++local.counts[index] >= 2 * kBatch) [[unlikely]] {
+            Drain(index, kBatch);
+        }
+    }
+
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    class Shared {
+    public:
+        void Push(size_t index, FreeNode* first, FreeNode* last) {
+            std::lock_guard guard(mutex_);
+            last->next = heads_[index];
+            heads_[index] = first;
+        }
+
+        void* Pop(size_t index) {
+            return PopBatch(index, 1);
+        }
+
+        // Returns a list of up to `count` (at least one) free blocks of class `index`.
+        FreeNode* PopBatch(size_t index, size_t count) {
+            std::lock_guard guard(mutex_);
+            if (heads_[index] == nullptr) {
+                Carve(index);
+            }
+            FreeNode* first = heads_[index];
+            FreeNode* last = first;
+            for (size_t i = 1; i < count && last->next != nullptr; ++i) {
+                last = last->next;
+            }
+            heads_[index] = last->next;
+            last->next = nullptr;
+            return first;
+        }
+
+    private:
+        // Called under `mutex_`.
+        void Carve(size_t index) {
+            size_t size = (index + 1) * kGranularity;
+            std::byte* slab = static_cast<std::byte*>(::operator new(size * kBatch));
+            slabs_.push_back(slab);
+            for (size_t i = kBatch; i-- > 0;) {
+                FreeNode* node = reinterpret_cast<FreeNode*>(slab + i * size);
+                node->next = heads_[index];
+                heads_[index] = node;
+            }
+        }
+
+        std::mutex mutex_;
+        FreeNode* heads_[kClasses] = {};
+        std::vector<std::byte*> slabs_;
+    };
+
+    // Trivially destructible, so it stays usable while other thread-locals are destroyed.
+    struct LocalCache {
+        FreeNode* heads[kClasses];
+        size_t counts[kClasses];
+        bool dead;
+    };
+
+    // Gives the cache back when the thread exits.
+    struct LocalGuard {
+        ~LocalGuard() {
+            for (size_t index = 0; index < kClasses; ++index) {
+                Drain(index, local.counts[index]);
+            }
+            local.dead = true;
+        }
+
+        bool armed = false;
+    };
+
+    static size_t ClassOf(size_t size) {
+        return size == 0 ? 0 : (size - 1) / kGranularity;
+    }
+
+    // Never destroyed: blocks may be freed during static destruction.
+    static Shared& Central() {
+        static Shared* shared = new Shared();
+        return *shared;
+    }
+
+    static void Refill(size_t index) {
+        guard.armed = true;
+        FreeNode* first = Central().PopBatch(index, kBatch);
+        size_t count = 0;
+        for (FreeNode* node = first; node != nullptr; node = node->next) {
+            ++count;
+        }
+        local.heads[index] = first;
+        local.counts[index] = count;
+    }
+
+    // Moves `count` blocks of class `index` from the thread cache to the shared list.
+    static void Drain(size_t index, size_t count) {
+        if (count == 0) {
+            return;
+        }
+        FreeNode* first = local.heads[index];
+        FreeNode* last = first;
+        for (size_t i = 1; i < count; ++i) {
+            last = last->next;
+        }
+        local.heads[index] = last->next;
+        local.counts[index] -= count;
+        Central().Push(index, first, last);
+    }
+
+    static thread_local LocalCache local;
+    static thread_local LocalGuard guard;
+};
+
+inline thread_local constinit BlockPool::LocalCache BlockPool::local = {};
+inline thread_local BlockPool::LocalGuard BlockPool::guard;
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Epoch-based reclamation.
+//
+// A reader announces the global epoch it saw before touching shared objects and withdraws the
+// announcement when it is done; both are plain stores, so reading costs no atomic
+// read-modify-write. Objects unlinked by writers are retired with the epoch current at that time.
+// The global epoch only moves forward once every active reader has announced it, so two steps
+// later nobody can still hold an object retired before them.
+
+class EpochDomain {
+public:
+    struct alignas(64) Record {
+        std::atomic<uint64_t> epoch = kIdle;
+        std::atomic<bool> active = false;
+        // Nesting depth of `EpochGuard`s on the owner thread.
+        int pins = 0;
+        Record* next = nullptr;
+    };
+
+    static EpochDomain& Default() {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    EpochDomain() = default;
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    // Nobody may read through the domain any more: reclaims everything still retired.
+    ~EpochDomain() {
+        for (const Retired& retired : retired_) {
+            retired.reclaim(retired.context);
+        }
+        Record* record = records_.load();
+        while (record != nullptr) {
+            Record* next = record->next;
+            delete record;
+            record = next;
+        }
+    }
+
+    // Records are reused, never freed while the domain lives.
+    Record* Acquire() {
+        for (Record* record = records_.load(std::memory_order_acquire); record != nullptr;
+             record = record->next) {
+            bool active = false;
+            if (!record->active.load(std::memory_order_relaxed) &&
+                record->active.compare_exchange_strong(active, true, std::memory_order_acquire)) {
+                return record;
+            }
+        }
+        Record* record = new Record();
+        record->active.store(true, std::memory_order_relaxed);
+        record->next = records_.load(std::memory_order_relaxed);
+        while (!records_.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+        }
+        return record;
+    }
+
+    void Release(Record* record) {
+        record->epoch.store(kIdle, std::memory_order_release);
+        record->active.store(false, std::memory_order_release);
+    }
+
+    void Pin(Record* record) {
+        if (record->pins++ != 0) {
+            return;
+        }
+#ifdef __SANITIZE_THREAD__
+        // ThreadSanitizer does not understand standalone fences.
+        record->epoch.store(epoch_.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+#else
+        record->epoch.store(epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // Either a writer scanning the records sees our epoch, or we see everything it unlinked
+        // before the scan.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+    }
+
+    void Unpin(Record* record) {
+        if (--record->pins == 0) {
+            record->epoch.store(kIdle, std::memory_order_release);
+        }
+    }
+
+    // Calls `reclaim(context)` once every reader active now has left its epoch.
+    void Retire(void* context, void (*reclaim)(void*)) {
+        std::vector<Retired> ready;
+        {
+            std::lock_guard guard(mutex_);
+            retired_.push_back({epoch_.load(std::memory_order_relaxed), context, reclaim});
+            Collect(ready);
+        }
+        for (const Retired& retired : ready) {
+            retired.reclaim(retired.context);
+        }
+    }
+
+    // Waits until everything retired so far is reclaimed. Must not be called while pinned.
+    void Synchronize() {
+        while (true) {
+            std::vector<Retired> ready;
+            bool done = false;
+            {
+                std::lock_guard guard(mutex_);
+                Collect(ready);
+                done = retired_.empty();
+            }
+            for (const Retired& retired : ready) {
+                retired.reclaim(retired.context);
+            }
+            if (done) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    static constexpr uint64_t kIdle = 0;
+
+    struct Retired {
+        uint64_t epoch;
+        void* context;
+        void (*reclaim)(void*);
+    };
+
+    // Advances the global epoch if every active reader is in it, then moves whatever is two epochs
+    // old to `ready`. Called under `mutex_`.
+    void Collect(std::vector<Retired>& ready) {
+#ifndef __SANITIZE_THREAD__
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+        uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+        bool quiescent = true;
+        for (Record* record = records_.load(std::memory_order_acquire); record != nullptr;
+             record = record->next) {
+            uint64_t seen = record->epoch.load(std::memory_order_seq_cst);
+            if (seen != kIdle && seen != epoch) {
+                quiescent = false;
+                break;
+            }
+        }
+        if (quiescent) {
+            epoch_.store(++epoch, std::memory_order_seq_cst);
+        }
+
+        auto kept = retired_.begin();
+        for (const Retired& retired : retired_) {
+            if (retired.epoch + 2 <= epoch) {
+                ready.push_back(retired);
+            } else {
+                *kept++ = retired;
+            }
+        }
+        retired_.erase(kept, retired_.end());
+    }
+
+    std::atomic<uint64_t> epoch_ = 1;
+    std::atomic<Record*> records_ = nullptr;
+    std::mutex mutex_;
+    std::vector<Retired> retired_;
+};
+
+// Keeps the calling thread inside the current epoch of the default domain: nothing retired from
+// now on is reclaimed until the guard is gone. Guards nest.
+class EpochGuard {
+public:
+    EpochGuard() : record_(LocalRecord()) {
+        EpochDomain::Default().Pin(record_);
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+
+    ~EpochGuard() {
+        EpochDomain::Default().Unpin(record_);
+    }
+
+private:
+    // One record per thread, handed back when the thread exits.
+    struct LocalHolder {
+        ~LocalHolder() {
+            if (record != nullptr) {
+                EpochDomain::Default().Release(record);
+            }
+        }
+
+        EpochDomain::Record* record = nullptr;
+    };
+
+    static EpochDomain::Record* LocalRecord() {
+        thread_local LocalHolder holder;
+        if (holder.record == nullptr) [[unlikely]] {
+            holder.record = EpochDomain::Default().Acquire();
+        }
+        return holder.record;
+    }
+
+    EpochDomain::Record* record_;
+};
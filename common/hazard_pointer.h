@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// https://en.cppreference.com/w/cpp/memory/hazard_pointer
+//
+// A reader publishes the address it is about to use in a hazard record, re-checks that the source
+// still points there, and can then use the object without touching its reference count. Whoever
+// drops the last reference retires the object instead of destroying it; retired objects are
+// reclaimed in batches, skipping the ones some record still covers.
+
+class HazardDomain {
+public:
+    struct Record {
+        std::atomic<const void*> hazard = nullptr;
+        std::atomic<bool> active = false;
+        Record* next = nullptr;
+    };
+
+    static HazardDomain& Default() {
+        static HazardDomain domain;
+        return domain;
+    }
+
+    HazardDomain() = default;
+    HazardDomain(const HazardDomain&) = delete;
+    HazardDomain& operator=(const HazardDomain&) = delete;
+
+    // Nobody may read through the domain any more: reclaims everything still retired.
+    ~HazardDomain() {
+        RetiredNode* node = retired_.exchange(nullptr);
+        while (node != nullptr) {
+            RetiredNode* next = node->next;
+            node->reclaim(node->context);
+            delete node;
+            node = next;
+        }
+        Record* record = records_.load();
+        while (record != nullptr) {
+            Record* next = record->next;
+            delete record;
+            record = next;
+        }
+    }
+
+    // Records are reused, never freed while the domain lives.
+    Record* Acquire() {
+        for (Record* record = records_.load(std::memory_order_acquire); record != nullptr;
+             record = record->next) {
+            bool active = false;
+            if (!record->active.load(std::memory_order_relaxed) &&
+                record->active.compare_exchange_strong(active, true, std::memory_order_acquire)) {
+                return record;
+            }
+        }
+        Record* record = new Record();
+        record_count_.fetch_add(1, std::memory_order_relaxed);
+        record->active.store(true, std::memory_order_relaxed);
+        record->next = records_.load(std::memory_order_relaxed);
+        while (!records_.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+        }
+        return record;
+    }
+
+    void Release(Record* record) {
+        record->hazard.store(nullptr, std::memory_order_release);
+        record->active.store(false, std::memory_order_release);
+    }
+
+    // Calls `reclaim(context)` once no hazard record holds `object`.
+    //
+    // A scan can keep up to one object per record, so it only runs once twice that many are
+    // retired: at least half of every scan is then reclaimed, however many readers there are.
+    void Retire(const void* object, void* context, void (*reclaim)(void*)) {
+        RetiredNode* node = new RetiredNode{object, context, reclaim, nullptr};
+        Push(node, node);
+        size_t threshold =
+            std::max(kReclaimThreshold, 2 * record_count_.load(std::memory_order_relaxed));
+        if (retired_count_.fetch_add(1, std::memory_order_relaxed) + 1 >= threshold) {
+            Reclaim();
+        }
+    }
+
+    // Reclaims every retired object that is not protected right now.
+    void Reclaim() {
+        RetiredNode* node = retired_.exchange(nullptr, std::memory_order_acq_rel);
+        if (node == nullptr) {
+            return;
+        }
+#ifndef __SANITIZE_THREAD__
+        // Pairs with the fence in `HazardPointer::Protect`: either the reader sees the source
+        // already changed, or we see its hazard.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+
+        std::vector<const void*> hazards;
+        for (Record* record = records_.load(std::memory_order_acquire); record != nullptr;
+             record = record->next) {
+            if (const void* hazard = record->hazard.load(std::memory_order_seq_cst)) {
+                hazards.push_back(hazard);
+            }
+        }
+        std::sort(hazards.begin(), hazards.end());
+
+        RetiredNode* kept_head = nullptr;
+        RetiredNode* kept_tail = nullptr;
+        size_t kept = 0;
+        size_t reclaimed = 0;
+        while (node != nullptr) {
+            RetiredNode* next = node->next;
+            if (std::binary_search(hazards.begin(), hazards.end(), node->object)) {
+                node->next = kept_head;
+                kept_head = node;
+                if (kept_tail == nullptr) {
+                    kept_tail = node;
+                }
+                ++kept;
+            } else {
+                node->reclaim(node->context);
+                delete node;
+                ++reclaimed;
+            }
+            node = next;
+        }
+        retired_count_.fetch_sub(reclaimed, std::memory_order_relaxed);
+        if (kept_head != nullptr) {
+            Push(kept_head, kept_tail);
+        }
+    }
+
+private:
+    static constexpr size_t kReclaimThreshold = 64;
+
+    struct RetiredNode {
+        const void* object;
+        void* context;
+        void (*reclaim)(void*);
+        RetiredNode* next;
+    };
+
+    void Push(RetiredNode* head, RetiredNode* tail) {
+        tail->next = retired_.load(std::memory_order_relaxed);
+        while (!retired_.compare_exchange_weak(tail->next, head, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+        }
+    }
+
+    std::atomic<Record*> records_ = nullptr;
+    std::atomic<RetiredNode*> retired_ = nullptr;
+    std::atomic<size_t> retired_count_ = 0;
+    std::atomic<size_t> record_count_ = 0;
+};
+
+// Owns one hazard record for its lifetime; keep one per reader thread and reuse it.
+class HazardPointer {
+public:
+    explicit HazardPointer(HazardDomain& domain = HazardDomain::Default())
+        : domain_(domain), record_(domain.Acquire()) {
+    }
+
+    HazardPointer(const HazardPointer&) = delete;
+    HazardPointer& operator=(const HazardPointer&) = delete;
+
+    ~HazardPointer() {
+        domain_.Release(record_);
+    }
+
+    // Loads `source` and keeps the object it points to from being reclaimed until the next
+    // `Protect` or `Reset`.
+    template <typename T>
+    T* Protect(const std::atomic<T*>& source) {
+        T* ptr = source.load(std::memory_order_relaxed);
+        while (true) {
+#ifdef __SANITIZE_THREAD__
+            // ThreadSanitizer does not understand standalone fences.
+            record_->hazard.store(ptr, std::memory_order_seq_cst);
+#else
+            // Release: whatever we did through the previously protected object has to happen
+            // before the reclaimer sees it is no longer covered.
+            record_->hazard.store(ptr, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+            T* current = source.load(std::memory_order_acquire);
+            if (current == ptr) {
+                return ptr;
+            }
+            ptr = current;
+        }
+    }
+
+    void Reset() {
+        record_->hazard.store(nullptr, std::memory_order_release);
+    }
+
+private:
+    HazardDomain& domain_;
+    HazardDomain::Record* record_;
+};
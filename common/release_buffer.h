@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// While a `ReleaseBuffer` is alive, smart pointers dropped on its thread do not touch their
+// reference counts right away: the decrements are queued, and flushed when the buffer fills up or
+// goes out of scope. References to the same object are coalesced, so clearing a vector of ten
+// thousand copies of a handful of pointers costs a handful of counter updates. Objects whose last
+// reference was queued are destroyed during the flush.
+//
+// Buffers nest; pointers dropped while a flush runs (by the destructors it calls) are queued as
+// well and flushed before it returns.
+class ReleaseBuffer {
+public:
+    using Release = void (*)(void* target, size_t count);
+
+    static constexpr size_t kCapacity = 1024;
+
+    ReleaseBuffer() : previous_(current) {
+        entries_.reserve(kCapacity);
+        batch_.reserve(kCapacity);
+        current = this;
+    }
+
+    ReleaseBuffer(const ReleaseBuffer&) = delete;
+    ReleaseBuffer& operator=(const ReleaseBuffer&) = delete;
+
+    ~ReleaseBuffer() {
+        Flush();
+        current = previous_;
+    }
+
+    // The innermost buffer of the calling thread, if any.
+    static ReleaseBuffer* Current() {
+        return current;
+    }
+
+    // Queues `release(target, 1)`.
+    void Push(void* target, Release release) {
+        entries_.push_back({target, release, 1});
+        if (entries_.size() >= kCapacity && !flushing_) {
+            Flush();
+        }
+    }
+
+    void Flush() {
+        flushing_ = true;
+        while (!entries_.empty()) {
+            batch_.swap(entries_);
+            std::sort(batch_.begin(), batch_.end(), [](const Entry& left, const Entry& right) {
+                return std::less<>()(left.target, right.target);
+            });
+            for (size_t i = 0; i < batch_.size();) {
+                Entry entry = batch_[i];
+                for (++i; i < batch_.size() && batch_[i].target == entry.target &&
+                          batch_[i].release == entry.release;
+                     ++i) {
+                    ++entry.count;
+                }
+                entry.release(entry.target, entry.count);
+            }
+            batch_.clear();
+        }
+        flushing_ = false;
+    }
+
+private:
+    struct Entry {
+        void* target;
+        Release release;
+        size_t count;
+    };
+
+    static inline thread_local ReleaseBuffer* current = nullptr;
+
+    ReleaseBuffer* previous_;
+    std::vector<Entry> entries_;
+    std::vector<Entry> batch_;
+    bool flushing_ = false;
+};
@@ -1,21 +1,15 @@
 #pragma once
 
-#include <cstddef> // for std::nullptr_t
-#include <utility> // for std::exchange / std::swap
-
-
-class SimpleCounter {
-public:
-    size_t IncRef();
-    size_t DecRef();
-    size_t RefCount() const;
-
-private:
-    size_t count_ = 0;
-};
-a#pragma once
+#include <common/arena.h>
+#include <common/hazard_pointer.h>
+#include <common/release_buffer.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>  // for std::nullptr_t
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
 #include <utility>  // for std::exchange / std::swap
 
 class SimpleCounter {
@@ -26,11 +20,11 @@ public:
         return ref_count_;
     };
 
-    size_t DecRef() {
+    size_t DecRef(size_t count = 1) {
         if (ref_count_ == 0) {
             return 0;
         }
-        --ref_count_;
+        ref_count_ -= std::min(count, ref_count_);
         return ref_count_;
     };
 
@@ -41,6 +35,47 @@ public:
     size_t ref_count_ = 0;
 };
 
+// Same interface as `SimpleCounter`, but references may be taken and dropped from many threads.
+class AtomicCounter {
+public:
+    AtomicCounter() = default;
+
+    // A copy of an object is a new object: nobody refers to it yet.
+    AtomicCounter(const AtomicCounter&) {
+    }
+
+    AtomicCounter& operator=(const AtomicCounter&) {
+        return *this;
+    }
+
+    size_t IncRef() {
+        // A new reference is always made from an existing one, so there is nothing to order here.
+        return ref_count_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    // Drops `count` references at once.
+    size_t DecRef(size_t count = 1) {
+#ifdef __SANITIZE_THREAD__
+        // ThreadSanitizer does not understand standalone fences.
+        return ref_count_.fetch_sub(count, std::memory_order_acq_rel) - count;
+#else
+        size_t left = ref_count_.fetch_sub(count, std::memory_order_release) - count;
+        if (left == 0) {
+            // Everything done through the other references happens before the deleter runs.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return left;
+#endif
+    }
+
+    size_t RefCount() const {
+        return ref_count_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<size_t> ref_count_ = 0;
+};
+
 struct DefaultDelete {
     template <typename T>
     static void Destroy(T* object) {
@@ -48,9 +83,39 @@ struct DefaultDelete {
     }
 };
 
+// For objects created by `AllocateIntrusive` or `MakeIntrusiveIn`: gives the memory back to the
+// allocator it came from (an arena keeps it).
+struct AllocatorDelete {
+    // Stored right in front of the object.
+    using Release = void (*)(void* object);
+
+    template <typename T>
+    static void Destroy(T* object) {
+        void* whole = object;
+        if constexpr (std::is_polymorphic_v<T>) {
+            // `T` may be a base of the type that was allocated.
+            whole = dynamic_cast<void*>(object);
+        }
+        (*(static_cast<Release*>(whole) - 1))(whole);
+    }
+};
+
+// Hands the object to `D` only once no `HazardPointer` covers it, so readers that found it through
+// an `std::atomic<Derived*>` may use it without taking a reference.
+template <typename D = DefaultDelete>
+struct HazardDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        HazardDomain::Default().Retire(object, object,
+                                       [](void* ptr) { D::Destroy(static_cast<T*>(ptr)); });
+    }
+};
+
 template <typename Derived, typename Counter, typename Deleter>
 class RefCounted {
 public:
+    using DeleterType = Deleter;
+
     // Increase reference strong_counter.
     void IncRef() {
         counter_.IncRef();
@@ -64,6 +129,13 @@ public:
         }
     };
 
+    // Drops `count` references with a single counter update.
+    void DecRef(size_t count) {
+        if (counter_.DecRef(count) == 0) {
+            Deleter::Destroy(static_cast<Derived*>(this));
+        }
+    };
+
     // Get current strong_counter value (the number of strong references).
     size_t RefCount() const {
         return counter_.RefCount();
@@ -76,6 +148,9 @@ private:
 template <typename Derived, typename D = DefaultDelete>
 using SimpleRefCounted = RefCounted<Derived, SimpleCounter, D>;
 
+template <typename Derived, typename D = DefaultDelete>
+using ThreadSafeRefCounted = RefCounted<Derived, AtomicCounter, D>;
+
 template <typename T>
 class IntrusivePtr {
     template <typename Y>
@@ -169,7 +244,7 @@ public:
     ~IntrusivePtr() {
         if (object == nullptr) {
         } else {
-            object->DecRef();
+            Release(object);
         }
     };
 
@@ -177,7 +252,7 @@ public:
     void Reset() {
         if (object == nullptr) {
         } else {
-            object->DecRef();
+            Release(object);
         }
         object = nullptr;
     };
@@ -185,7 +260,7 @@ public:
     void Reset(T* ptr) {
         if (object == nullptr) {
         } else {
-            object->DecRef();
+            Release(object);
         }
         object = ptr;
         object->IncRef();
@@ -195,7 +270,7 @@ public:
     void Reset(U* ptr) {
         if (object == nullptr) {
         } else {
-            object->DecRef();
+            Release(object);
         }
         object = ptr;
         object->IncRef();
@@ -234,6 +309,25 @@ public:
     };
 
     T* object = nullptr;
+
+private:
+    // Drops one reference, or queues it if the thread has a `ReleaseBuffer`.
+    static void Release(T* ptr) {
+        if (ReleaseBuffer* buffer = ReleaseBuffer::Current()) [[unlikely]] {
+            buffer->Push(ptr, [](void* target, size_t count) {
+                T* object = static_cast<T*>(target);
+                if constexpr (requires { object->DecRef(count); }) {
+                    object->DecRef(count);
+                } else {
+                    for (; count != 0; --count) {
+                        object->DecRef();
+                    }
+                }
+            });
+        } else {
+            ptr->DecRef();
+        }
+    }
 };
 
 /*template <typename T, typename... Args>
@@ -244,76 +338,103 @@ IntrusivePtr<T> MakeIntrusive(Args&&... args) {
     return ans;
 };*/
 
+// `T` must not be destroyed by `AllocatorDelete`: a plain `new` stores no release function in
+// front of the object for it to call.
 template <typename T, typename... Args>
 IntrusivePtr<T> MakeIntrusive(Args&&... args) {
+    if constexpr (requires { typename T::DeleterType; }) {
+        static_assert(!std::is_same_v<typename T::DeleterType, AllocatorDelete> &&
+                          !std::is_same_v<typename T::DeleterType, HazardDelete<AllocatorDelete>>,
+                      "Use AllocateIntrusive or MakeIntrusiveIn for types released by "
+                      "AllocatorDelete");
+    }
     return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
 }
-struct DefaultDelete {
-    template <typename T>
-    static void Destroy(T* object) {
-        delete object;
-    }
-};
-
-template <typename Derived, typename Counter, typename Deleter>
-class RefCounted {
-public:
-    // Increase reference counter.
-    void IncRef();
-
-    // Decrease reference counter.
-    // Destroy object using Deleter when the last instance dies.
-    void DecRef();
 
-    // Get current counter value (the number of strong references).
-    size_t RefCount() const;
+// Memory layout of an object created by `AllocateIntrusive`: the allocator (unless it is
+// stateless), the release function `AllocatorDelete` looks up, then the object itself.
+template <typename T, typename Alloc>
+class IntrusiveAllocation {
+    static constexpr size_t kAlign = std::max({alignof(T), alignof(Alloc), alignof(void*)});
 
-private:
-    Counter counter_;
-};
+    struct alignas(kAlign) Chunk {
+        std::byte bytes[kAlign];
+    };
 
-template <typename Derived, typename D = DefaultDelete>
-using SimpleRefCounted = RefCounted<Derived, SimpleCounter, D>;
+    using ChunkAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Chunk>;
+    using Traits = std::allocator_traits<ChunkAlloc>;
 
-template <typename T>
-class IntrusivePtr {
-    template <typename Y>
-    friend class IntrusivePtr;
+    static constexpr bool kStoreAlloc =
+        !Traits::is_always_equal::value || !std::is_default_constructible_v<ChunkAlloc>;
+    static constexpr size_t kAllocSize = kStoreAlloc ? sizeof(ChunkAlloc) : 0;
+    static constexpr size_t kObjectOffset =
+        (kAllocSize + sizeof(AllocatorDelete::Release) + kAlign - 1) / kAlign * kAlign;
+    static constexpr size_t kChunks = (kObjectOffset + sizeof(T) + kAlign - 1) / kAlign;
 
 public:
-    // Constructors
-    IntrusivePtr();
-    IntrusivePtr(std::nullptr_t);
-    IntrusivePtr(T* ptr);
-
-    template <typename Y>
-    IntrusivePtr(const IntrusivePtr<Y>& other);
-
-    template <typename Y>
-    IntrusivePtr(IntrusivePtr<Y>&& other);
-
-    IntrusivePtr(const IntrusivePtr& other);
-    IntrusivePtr(IntrusivePtr&& other);
-
-    // `operator=`-s
-    IntrusivePtr& operator=(const IntrusivePtr& other);
-    IntrusivePtr& operator=(IntrusivePtr&& other);
-
-    // Destructor
-    ~IntrusivePtr();
-
-    // Modifiers
-    void Reset();
-    void Reset(T* ptr);
-    void Swap(IntrusivePtr& other);
+    template <typename... Args>
+    static T* Create(const Alloc& alloc, Args&&... args) {
+        ChunkAlloc chunk_alloc(alloc);
+        std::byte* base = reinterpret_cast<std::byte*>(Traits::allocate(chunk_alloc, kChunks));
+        T* object;
+        try {
+            object = new (base + kObjectOffset) T(std::forward<Args>(args)...);
+        } catch (...) {
+            Traits::deallocate(chunk_alloc, reinterpret_cast<Chunk*>(base), kChunks);
+            throw;
+        }
+        if constexpr (kStoreAlloc) {
+            new (base) ChunkAlloc(std::move(chunk_alloc));
+        }
+        new (base + kObjectOffset - sizeof(AllocatorDelete::Release))
+            AllocatorDelete::Release(&Release);
+        return object;
+    }
 
-    // Observers
-    T* Get() const;
-    T& operator*() const;
-    T* operator->() const;
-    size_t UseCount() const;
-    explicit operator bool() const;
+private:
+    static void Release(void* whole) {
+        std::byte* base = static_cast<std::byte*>(whole) - kObjectOffset;
+        static_cast<T*>(whole)->~T();
+        if constexpr (kStoreAlloc) {
+            ChunkAlloc* stored = reinterpret_cast<ChunkAlloc*>(base);
+            ChunkAlloc chunk_alloc(std::move(*stored));
+            stored->~ChunkAlloc();
+            Traits::deallocate(chunk_alloc, reinterpret_cast<Chunk*>(base), kChunks);
+        } else {
+            ChunkAlloc chunk_alloc;
+            Traits::deallocate(chunk_alloc, reinterpret_cast<Chunk*>(base), kChunks);
+        }
+    }
 };
 
-template <typename T, typename ...Args>
-IntrusivePtr<T> MakeIntrusive(Args&& ...args);
+// Same as `MakeIntrusive`, but the object comes from `alloc`, which may also be a
+// `std::pmr::memory_resource*`. `T` has to be destroyed by `AllocatorDelete`.
+template <typename T, typename Alloc, typename... Args>
+IntrusivePtr<T> AllocateIntrusive(const Alloc& alloc, Args&&... args) {
+    static_assert(std::is_same_v<typename T::DeleterType, AllocatorDelete>,
+                  "AllocateIntrusive needs a type released by AllocatorDelete");
+    if constexpr (std::is_convertible_v<Alloc, std::pmr::memory_resource*>) {
+        return AllocateIntrusive<T>(std::pmr::polymorphic_allocator<T>(alloc),
+                                    std::forward<Args>(args)...);
+    } else {
+        T* object = IntrusiveAllocation<T, Alloc>::Create(alloc, std::forward<Args>(args)...);
+        return IntrusivePtr<T>(object);
+    }
+}
+
+// Same as `MakeIntrusive`, but the object is placed in `arena` (see common/arena.h). It is still
+// destroyed once the last reference goes; the memory goes back only when the arena is reset. `T`
+// has to be destroyed by `AllocatorDelete`.
+template <typename T, typename... Args>
+IntrusivePtr<T> MakeIntrusiveIn(Arena& arena, Args&&... args) {
+    static_assert(std::is_same_v<typename T::DeleterType, AllocatorDelete>,
+                  "MakeIntrusiveIn needs a type released by AllocatorDelete");
+    constexpr size_t kAlign = std::max(alignof(T), alignof(AllocatorDelete::Release));
+    constexpr size_t kObjectOffset =
+        (sizeof(AllocatorDelete::Release) + kAlign - 1) / kAlign * kAlign;
+    std::byte* base = static_cast<std::byte*>(arena.Allocate(kObjectOffset + sizeof(T), kAlign));
+    T* object = new (base + kObjectOffset) T(std::forward<Args>(args)...);
+    new (base + kObjectOffset - sizeof(AllocatorDelete::Release))
+        AllocatorDelete::Release([](void* whole) { static_cast<T*>(whole)->~T(); });
+    return IntrusivePtr<T>(object);
+}
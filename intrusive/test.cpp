@@ -4,7 +4,12 @@
 
 #include "allocations_checker.h"
 
+#include <array>
+#include <atomic>
+#include <memory_resource>
 #include <string>
+#include <thread>
+#include <vector>
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -386,3 +391,128 @@ TEST_CASE("Object pool") {
         REQUIRE(strs.NumInUse() == 1);
     }
 }
+
+struct Retired : ObjectCounters<Retired>, ThreadSafeRefCounted<Retired, HazardDelete<>> {};
+
+TEST_CASE("Hazard pointers") {
+    Retired::ResetCounters();
+    HazardPointer hazard;
+    {
+        IntrusivePtr<Retired> owner(new Retired());
+        std::atomic<Retired*> source = owner.Get();
+        Retired* read = hazard.Protect(source);
+        REQUIRE(read == owner.Get());
+
+        owner.Reset();
+        HazardDomain::Default().Reclaim();
+        REQUIRE(Retired::NumAlive() == 1);
+
+        hazard.Reset();
+        HazardDomain::Default().Reclaim();
+        REQUIRE(Retired::NumAlive() == 0);
+    }
+}
+
+struct SharedCounter : ThreadSafeRefCounted<SharedCounter> {
+    SharedCounter(std::atomic<int>* destroyed) : destroyed(destroyed) {
+    }
+
+    ~SharedCounter() {
+        destroyed->fetch_add(1);
+    }
+
+    std::atomic<int>* destroyed;
+};
+
+TEST_CASE("Thread-safe counter") {
+    constexpr int kThreads = 4;
+    constexpr int kIterations = 20'000;
+
+    std::atomic<int> destroyed = 0;
+    auto shared = MakeIntrusive<SharedCounter>(&destroyed);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back([copy = shared] {
+            for (int j = 0; j < kIterations; ++j) {
+                IntrusivePtr<SharedCounter> another = copy;
+            }
+        });
+    }
+    REQUIRE(destroyed == 0);
+    shared.Reset();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(destroyed == 1);
+}
+
+TEST_CASE("Release buffer") {
+    CountedString::ResetCounters();
+    IntrusivePtr<CountedString> str(new CountedString("buffered"));
+    std::vector<IntrusivePtr<CountedString>> copies(3000, str);
+    {
+        ReleaseBuffer buffer;
+        copies.clear();
+        str.Reset();
+        REQUIRE(CountedString::NumAlive() == 1);
+    }
+    REQUIRE(CountedString::NumAlive() == 0);
+
+    std::atomic<int> destroyed = 0;
+    IntrusivePtr<SharedCounter> shared(new SharedCounter(&destroyed));
+    {
+        ReleaseBuffer buffer;
+        std::vector<IntrusivePtr<SharedCounter>> many(100, shared);
+        many.clear();
+        REQUIRE(shared->RefCount() == 101);
+    }
+    REQUIRE(shared->RefCount() == 1);
+    REQUIRE(destroyed == 0);
+    shared.Reset();
+    REQUIRE(destroyed == 1);
+}
+
+TEST_CASE("AllocateIntrusive") {
+    struct Base : ThreadSafeRefCounted<Base, AllocatorDelete> {
+        virtual ~Base() = default;
+    };
+
+    struct Derived : std::string, Base {
+        using std::string::basic_string;
+    };
+
+    std::array<std::byte, 1024> buffer;
+    std::pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size(),
+                                                 std::pmr::null_memory_resource());
+    EXPECT_ZERO_ALLOCATIONS(auto str = AllocateIntrusive<Derived>(&resource, "pooled");
+                            IntrusivePtr<Base> base = str; str.Reset(); base.Reset(););
+
+    auto str = AllocateIntrusive<Derived>(std::allocator<Derived>(), "heap");
+    IntrusivePtr<Base> base = str;
+    str.Reset();
+    REQUIRE(base.UseCount() == 1);
+}
+
+TEST_CASE("MakeIntrusiveIn") {
+    struct Node : ThreadSafeRefCounted<Node, AllocatorDelete> {
+        Node(int* destroyed) : destroyed(destroyed) {
+        }
+        ~Node() {
+            ++*destroyed;
+        }
+        int* destroyed;
+    };
+
+    Arena arena;
+    int destroyed = 0;
+    {
+        auto first = MakeIntrusiveIn<Node>(arena, &destroyed);
+        EXPECT_ZERO_ALLOCATIONS(auto second = MakeIntrusiveIn<Node>(arena, &destroyed);
+                                auto copy = second;);
+        REQUIRE(destroyed == 1);
+        first.Reset();
+        REQUIRE(destroyed == 2);
+    }
+    arena.Reset();
+    REQUIRE(arena.Capacity() > 0);
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "shared.h"
+#include "weak.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+
+// https://en.cppreference.com/w/cpp/memory/shared_ptr/atomic2
+
+// A slot holding a `SharedPtr` or a `WeakPtr` which can be loaded and replaced from many threads at
+// once.
+//
+// Every stored value is copied into its own immutable node (a `HolderBlock<Value>`), and the slot
+// word packs the node pointer together with the number of node references already claimed by
+// readers. When a node is installed, the slot pays for `kPrepaid` reader references plus one of its
+// own up front. A reader claims one of them with a single CAS on the slot word, copies the value
+// out of the node and releases the node reference as usual; it never waits for a writer. Writers
+// swap the whole word and give back whatever was left unclaimed.
+//
+// The reader whose claim uses up half of the prepaid references buys `kRefill` more and takes them
+// off the claimed count, while the other readers go on claiming the rest. `Load` is still not
+// lock-free: if that reader is descheduled before it pays and the remaining half runs out too,
+// further readers wait (yielding) until it is done, since a reader that has not claimed anything
+// cannot touch the node safely.
+template <typename Value>
+class AtomicSlot {
+    using Node = HolderBlock<Value>;
+
+    static_assert(sizeof(uintptr_t) == 8, "AtomicSlot packs a pointer into 48 bits");
+
+    static constexpr int kClaimBits = 16;
+    static constexpr uintptr_t kPrepaid = (uintptr_t{1} << kClaimBits) - 1;
+    static constexpr uintptr_t kRefill = (kPrepaid + 1) / 2;
+
+public:
+    AtomicSlot() = default;
+
+    AtomicSlot(Value value) : word_(Install(std::move(value))) {
+    }
+
+    AtomicSlot(const AtomicSlot&) = delete;
+    AtomicSlot& operator=(const AtomicSlot&) = delete;
+
+    ~AtomicSlot() {
+        Retire(word_.load(std::memory_order_acquire));
+    }
+
+    Value Load() const {
+        Node* node = Claim();
+        if (node == nullptr) {
+            return Value();
+        }
+        Value ans = *node->GetPointer();
+        node->ReleaseStrong();
+        return ans;
+    }
+
+    void Store(Value desired) {
+        Retire(word_.exchange(Install(std::move(desired)), std::memory_order_acq_rel));
+    }
+
+    Value Exchange(Value desired) {
+        uintptr_t old = word_.exchange(Install(std::move(desired)), std::memory_order_acq_rel);
+        Value ans;
+        if (Node* node = NodeOf(old)) {
+            ans = *node->GetPointer();
+        }
+        Retire(old);
+        return ans;
+    }
+
+    // Stores `desired` if the slot holds the same pointer sharing ownership with `expected`.
+    // Otherwise loads the current value into `expected`. Never fails spuriously.
+    bool CompareExchange(Value& expected, Value desired) {
+        uintptr_t fresh = 0;
+        while (true) {
+            Node* node = Claim();
+            if (node == nullptr ? !IsEmpty(expected) : !Same(*node->GetPointer(), expected)) {
+                expected = node == nullptr ? Value() : *node->GetPointer();
+                if (node != nullptr) {
+                    node->ReleaseStrong();
+                }
+                Retire(fresh);
+                return false;
+            }
+            if (fresh == 0) {
+                fresh = Install(std::move(desired));
+            }
+
+            uintptr_t word = word_.load(std::memory_order_acquire);
+            bool replaced = false;
+            while (NodeOf(word) == node) {
+                if (word_.compare_exchange_weak(word, fresh, std::memory_order_acq_rel,
+                                                std::memory_order_acquire)) {
+                    Retire(word);
+                    replaced = true;
+                    break;
+                }
+            }
+            if (node != nullptr) {
+                node->ReleaseStrong();
+            }
+            if (replaced) {
+                return true;
+            }
+            // Somebody stored a new value in between: compare against it again.
+        }
+    }
+
+    // Whether the slot word is lock-free. `Load` may still wait for a refill (see above).
+    bool IsLockFree() const {
+        return word_.is_lock_free();
+    }
+
+private:
+    static bool IsEmpty(const Value& value) {
+        return value.block == nullptr && value.real_object == nullptr;
+    }
+
+    static bool Same(const Value& left, const Value& right) {
+        return left.block == right.block && left.real_object == right.real_object;
+    }
+
+    static Node* NodeOf(uintptr_t word) {
+        return reinterpret_cast<Node*>(word >> kClaimBits);
+    }
+
+    static uintptr_t ClaimedOf(uintptr_t word) {
+        return word & kPrepaid;
+    }
+
+    static uintptr_t Pack(Node* node, uintptr_t claimed) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(node);
+        assert((address >> (64 - kClaimBits)) == 0);
+        return (address << kClaimBits) | claimed;
+    }
+
+    // Returns a packed word owning `kPrepaid + 1` references on a new node holding `value`.
+    static uintptr_t Install(Value value) {
+        if (IsEmpty(value)) {
+            return 0;
+        }
+        Node* node = new Node(std::move(value));
+        node->IncStrong(kPrepaid);
+        return Pack(node, 0);
+    }
+
+    // Gives back the references the slot still owns on a word it no longer holds.
+    static void Retire(uintptr_t word) {
+        if (Node* node = NodeOf(word)) {
+            node->ReleaseStrong(kPrepaid + 1 - ClaimedOf(word));
+        }
+    }
+
+    // Returns the current node with one reference owned by the caller, or nullptr.
+    Node* Claim() const {
+        uintptr_t word = word_.load(std::memory_order_acquire);
+        while (true) {
+            Node* node = NodeOf(word);
+            if (node == nullptr) {
+                return nullptr;
+            }
+            if (ClaimedOf(word) == kPrepaid) {
+                // Every prepaid reference is claimed and the refill has not landed yet.
+                std::this_thread::yield();
+                word = word_.load(std::memory_order_acquire);
+                continue;
+            }
+            if (word_.compare_exchange_weak(word, word + 1, std::memory_order_acquire,
+                                            std::memory_order_acquire)) {
+                if (ClaimedOf(word + 1) == kRefill) {
+                    Refill(node);
+                }
+                return node;
+            }
+        }
+    }
+
+    // Only one refill is pending at a time: the claimed count cannot get back to `kRefill` before
+    // this one takes `kRefill` off it.
+    void Refill(Node* node) const {
+        node->IncStrong(kRefill);
+        uintptr_t word = word_.load(std::memory_order_acquire);
+        while (NodeOf(word) == node) {
+            if (word_.compare_exchange_weak(word, word - kRefill, std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+                return;
+            }
+        }
+        // The node has been swapped out meanwhile; the writer only settled the references the slot
+        // owned before the refill. Our own claimed reference keeps the node alive.
+        node->ReleaseStrong(kRefill);
+    }
+
+    mutable std::atomic<uintptr_t> word_ = 0;
+};
+
+template <typename T>
+class AtomicSharedPtr : public AtomicSlot<SharedPtr<T>> {
+public:
+    using AtomicSlot<SharedPtr<T>>::AtomicSlot;
+};
+
+template <typename T>
+class AtomicWeakPtr : public AtomicSlot<WeakPtr<T>> {
+public:
+    using AtomicSlot<WeakPtr<T>>::AtomicSlot;
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "shared.h"
+#include "weak.h"
+
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+// A `SharedPtr<T>` squeezed into one word, for containers holding very many of them.
+//
+// It can only point at an object made by `MakeShared` or `MakeSharedForOverwrite` and at nothing
+// else: the block then knows where its object is (at a fixed offset in a `HolderBlock<T>`, or in a
+// `SplitHolderBlock<T>` for large objects), so only the block pointer is stored and `Get()` is
+// computed from it. Pointers with any other control block, or aliasing some other object, have to
+// stay `SharedPtr`s.
+//
+// Converts to `SharedPtr<T>` and `WeakPtr<T>`, and back from them when `Fits` says so.
+template <typename T>
+class CompactSharedPtr {
+public:
+    using Block = MakeSharedBlock<T>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    CompactSharedPtr() {
+        block = nullptr;
+    };
+
+    CompactSharedPtr(std::nullptr_t) {
+        block = nullptr;
+    };
+
+    // Throws `std::invalid_argument` unless `Fits(other)`.
+    explicit CompactSharedPtr(const SharedPtr<T>& other) {
+        block = Adopt(other.block, other.real_object);
+        if (block != nullptr) {
+            block->IncStrong();
+        }
+    };
+
+    explicit CompactSharedPtr(SharedPtr<T>&& other) {
+        block = Adopt(other.block, other.real_object);
+        other.block = nullptr;
+        other.real_object = nullptr;
+    };
+
+    // Promotes `other` like `SharedPtr(const WeakPtr&)`: throws `BadWeakPtr` if the object is
+    // gone, and `std::invalid_argument` unless the pointer fits.
+    explicit CompactSharedPtr(const WeakPtr<T>& other) : CompactSharedPtr(SharedPtr<T>(other)) {
+    };
+
+    CompactSharedPtr(const CompactSharedPtr& other) {
+        block = other.block;
+        if (block != nullptr) {
+            block->IncStrong();
+        }
+    };
+
+    CompactSharedPtr(CompactSharedPtr&& other) {
+        block = std::exchange(other.block, nullptr);
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    CompactSharedPtr& operator=(const CompactSharedPtr& other) {
+        // Taken before the reset, which would clear it on self-assignment.
+        Block* acquired = other.block;
+        if (acquired != nullptr) {
+            acquired->IncStrong();
+        }
+        Reset();
+        block = acquired;
+        return *this;
+    };
+
+    CompactSharedPtr& operator=(CompactSharedPtr&& other) {
+        if (this != &other) {
+            Reset();
+            block = std::exchange(other.block, nullptr);
+        }
+        return *this;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~CompactSharedPtr() {
+        Reset();
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        Block* released = std::exchange(block, nullptr);
+        if (released != nullptr) {
+            released->DropStrong();
+        }
+    };
+
+    void Swap(CompactSharedPtr& other) {
+        std::swap(block, other.block);
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        return block != nullptr ? block->GetPointer() : nullptr;
+    };
+    T& operator*() const {
+        return *block->GetPointer();
+    };
+    T* operator->() const {
+        return block->GetPointer();
+    };
+
+    size_t UseCount() const {
+        if (block != nullptr) {
+            return block->StrongCount();
+        }
+        return 0;
+    };
+    explicit operator bool() const {
+        return block != nullptr;
+    };
+
+    // Whether `other` can be held by a `CompactSharedPtr`. Empty pointers can; an expired `WeakPtr`
+    // to a large object (whose block no longer knows the address) cannot.
+    static bool Fits(const SharedPtr<T>& other) {
+        return Owns(other.block, other.real_object);
+    };
+    static bool Fits(const WeakPtr<T>& other) {
+        return Owns(other.block, other.real_object);
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Conversions
+
+    operator SharedPtr<T>() const& {
+        SharedPtr<T> ans;
+        if (block != nullptr) {
+            block->IncStrong();
+            ans.block = block;
+            ans.real_object = block->GetPointer();
+        }
+        return ans;
+    };
+
+    operator SharedPtr<T>() && {
+        SharedPtr<T> ans;
+        if (block != nullptr) {
+            ans.real_object = block->GetPointer();
+            ans.block = std::exchange(block, nullptr);
+        }
+        return ans;
+    };
+
+    operator WeakPtr<T>() const {
+        WeakPtr<T> ans;
+        if (block != nullptr) {
+            block->IncWeak();
+            ans.block = block;
+            ans.real_object = block->GetPointer();
+        }
+        return ans;
+    };
+
+    Block* block;
+
+private:
+    // `block` is exactly a `Block` (derived blocks have their own `dispatch`) and `real_object` is
+    // the object in it.
+    static bool Owns(BaseBlock* block, T* real_object) {
+        if (block == nullptr) {
+            return real_object == nullptr;
+        }
+        return block->dispatch == &DispatchTo<Block> &&
+               static_cast<Block*>(block)->GetPointer() == real_object;
+    };
+
+    static Block* Adopt(BaseBlock* block, T* real_object) {
+        if (!Owns(block, real_object)) {
+            throw std::invalid_argument("CompactSharedPtr needs an object made by MakeShared");
+        }
+        return static_cast<Block*>(block);
+    };
+};
+
+template <typename T, typename U>
+inline bool operator==(const CompactSharedPtr<T>& left, const CompactSharedPtr<U>& right) {
+    return left.Get() == right.Get();
+};
+
+// Same as `MakeShared`, but returns a `CompactSharedPtr`.
+template <typename T, typename... Args>
+CompactSharedPtr<T> MakeCompactShared(Args&&... args) {
+    return CompactSharedPtr<T>(MakeShared<T>(std::forward<Args>(args)...));
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "shared.h"
+
+#include <common/epoch.h>
+
+#include <atomic>
+#include <utility>
+
+// A read-mostly value published by writers and read without touching any reference count.
+//
+// Every version is built by `MakeShared`, so it lives in a `MakeSharedBlock<T>` (together with its
+// counters, unless `T` is large enough to be stored apart). The cell owns one strong reference to
+// the current version. `Read()` pins the epoch of the calling thread and hands out a `const T&`
+// that stays valid until the guard is destroyed: `Publish` swaps the version pointer and retires
+// the old block, whose reference is only released once every reader pinned at that time has left
+// its epoch.
+//
+// Readers must not block writers for long: a pinned thread holds back reclamation of every cell.
+template <typename T>
+class RcuCell {
+    using Version = MakeSharedBlock<T>;
+
+public:
+    class ReadGuard {
+    public:
+        const T& operator*() const {
+            return *value_;
+        }
+
+        const T* operator->() const {
+            return value_;
+        }
+
+        const T* Get() const {
+            return value_;
+        }
+
+    private:
+        friend class RcuCell;
+
+        explicit ReadGuard(const std::atomic<Version*>& current)
+            : value_(current.load(std::memory_order_acquire)->GetPointer()) {
+        }
+
+        // Must come first: the value is only loaded once the epoch is pinned.
+        EpochGuard pin_;
+        const T* value_;
+    };
+
+    template <typename... Args>
+    explicit RcuCell(Args&&... args) : current_(Build(std::forward<Args>(args)...)) {
+    }
+
+    RcuCell(const RcuCell&) = delete;
+    RcuCell& operator=(const RcuCell&) = delete;
+
+    // Nobody may be reading the cell any more.
+    ~RcuCell() {
+        current_.load(std::memory_order_relaxed)->ReleaseStrong();
+    }
+
+    ReadGuard Read() const {
+        return ReadGuard(current_);
+    }
+
+    // A counted reference to the current version, for readers that need it past their guard.
+    SharedPtr<T> Load() const {
+        EpochGuard pin;
+        Version* version = current_.load(std::memory_order_acquire);
+        version->IncStrong();
+        SharedPtr<T> ans;
+        ans.block = version;
+        ans.real_object = version->GetPointer();
+        return ans;
+    }
+
+    // Replaces the value with `T(args...)`.
+    template <typename... Args>
+    void Publish(Args&&... args) {
+        Version* old = current_.exchange(Build(std::forward<Args>(args)...),
+                                         std::memory_order_acq_rel);
+        EpochDomain::Default().Retire(
+            old, [](void* version) { static_cast<Version*>(version)->ReleaseStrong(); });
+    }
+
+private:
+    // Takes over the reference of a fresh `MakeShared` result.
+    template <typename... Args>
+    static Version* Build(Args&&... args) {
+        SharedPtr<T> ptr = MakeShared<T>(std::forward<Args>(args)...);
+        Version* version = static_cast<Version*>(ptr.block);
+        ptr.block = nullptr;
+        ptr.real_object = nullptr;
+        return version;
+    }
+
+    std::atomic<Version*> current_;
+};
@@ -2,43 +2,911 @@
 
 #include "sw_fwd.h"  // Forward declaration
 
+#include <unique/compressed_pair.h>
+#include <unique/unique.h>
+
+#include <common/arena.h>
+#include <common/block_pool.h>
+#include <common/hazard_pointer.h>
+#include <common/release_buffer.h>
+
 #include <cstddef>  // std::nullptr_t
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
 #include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // https://en.cppreference.com/w/cpp/memory/shared_ptr
 
 class ESFTBase;
 
+// Reference counting policies for control blocks.
+//
+// `SingleThreadedPolicy` keeps plain counters: it is the cheapest one, but every copy of a pointer
+// has to stay on the thread that owns it. `AtomicPolicy` lets pointers to the same block be copied
+// and released from different threads without any external locking.
+//
+// Define SMART_PTRS_SINGLE_THREADED before including this header to get the single-threaded one.
+//
+// Control blocks keep both of their counts in one 64-bit `Counts` word: strong in the low half,
+// weak in the high half, so each is limited to 2^32 - 1 references (debug builds check for
+// overflow).
+// `Counter` is a plain full-width counter.
+namespace packed_counts {
+
+constexpr uint64_t kStrongMask = (uint64_t{1} << 32) - 1;
+constexpr int kWeakShift = 32;
+// One strong reference and the weak one held on its behalf.
+constexpr uint64_t kInitial = (uint64_t{1} << kWeakShift) | 1;
+
+inline uint64_t Strong(uint64_t counts) {
+    return counts & kStrongMask;
+}
+
+inline uint64_t Weak(uint64_t counts) {
+    return counts >> kWeakShift;
+}
+
+// `count` more references on top of `before` still fit.
+inline bool Fits(uint64_t before, size_t count) {
+    return before + count <= kStrongMask;
+}
+
+}  // namespace packed_counts
+
+struct SingleThreadedPolicy {
+    using Counter = size_t;
+    using Counts = uint64_t;
+
+    static void Increment(Counter& counter, size_t count = 1) {
+        counter += count;
+    }
+
+    // Returns the value after the decrement.
+    static size_t Decrement(Counter& counter, size_t count = 1) {
+        counter -= count;
+        return counter;
+    }
+
+    static bool IncrementIfNonZero(Counter& counter) {
+        if (counter == 0) {
+            return false;
+        }
+        ++counter;
+        return true;
+    }
+
+    static size_t Load(const Counter& counter) {
+        return counter;
+    }
+
+    static void IncrementStrong(Counts& counts, size_t count = 1) {
+        assert(packed_counts::Fits(packed_counts::Strong(counts), count));
+        counts += count;
+    }
+
+    static void IncrementWeak(Counts& counts) {
+        assert(packed_counts::Fits(packed_counts::Weak(counts), 1));
+        counts += uint64_t{1} << packed_counts::kWeakShift;
+    }
+
+    // Both return the count left after the decrement.
+    static size_t DecrementStrong(Counts& counts, size_t count = 1) {
+        counts -= count;
+        return packed_counts::Strong(counts);
+    }
+
+    static size_t DecrementWeak(Counts& counts) {
+        counts -= uint64_t{1} << packed_counts::kWeakShift;
+        return packed_counts::Weak(counts);
+    }
+
+    static bool IncrementStrongIfNonZero(Counts& counts) {
+        if (packed_counts::Strong(counts) == 0) {
+            return false;
+        }
+        IncrementStrong(counts);
+        return true;
+    }
+
+    static size_t LoadStrong(const Counts& counts) {
+        return packed_counts::Strong(counts);
+    }
+
+    static size_t LoadWeak(const Counts& counts) {
+        return packed_counts::Weak(counts);
+    }
+
+    static uint64_t LoadCounts(const Counts& counts) {
+        return counts;
+    }
+};
+
+struct AtomicPolicy {
+    using Counter = std::atomic<size_t>;
+
+    static void Increment(Counter& counter, size_t count = 1) {
+        // A new reference is always made from an existing one, so there is nothing to order here.
+        counter.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Returns the value after the decrement.
+    static size_t Decrement(Counter& counter, size_t count = 1) {
+#ifdef __SANITIZE_THREAD__
+        // ThreadSanitizer does not understand standalone fences.
+        return counter.fetch_sub(count, std::memory_order_acq_rel) - count;
+#else
+        size_t left = counter.fetch_sub(count, std::memory_order_release) - count;
+        if (left == 0) {
+            // Only the last owner pays for the fence: it makes every write done through the other
+            // (already released) owners visible before the object is destroyed.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return left;
+#endif
+    }
+
+    static bool IncrementIfNonZero(Counter& counter) {
+        size_t current = counter.load(std::memory_order_relaxed);
+        while (current != 0) {
+            if (counter.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static size_t Load(const Counter& counter) {
+        return counter.load(std::memory_order_acquire);
+    }
+
+    using Counts = std::atomic<uint64_t>;
+
+    static void IncrementStrong(Counts& counts, size_t count = 1) {
+        [[maybe_unused]] uint64_t before = counts.fetch_add(count, std::memory_order_relaxed);
+        assert(packed_counts::Fits(packed_counts::Strong(before), count));
+    }
+
+    static void IncrementWeak(Counts& counts) {
+        [[maybe_unused]] uint64_t before =
+            counts.fetch_add(uint64_t{1} << packed_counts::kWeakShift, std::memory_order_relaxed);
+        assert(packed_counts::Fits(packed_counts::Weak(before), 1));
+    }
+
+    // Both return the count left after the decrement, ordered as by `Decrement`.
+    static size_t DecrementStrong(Counts& counts, size_t count = 1) {
+#ifdef __SANITIZE_THREAD__
+        return packed_counts::Strong(counts.fetch_sub(count, std::memory_order_acq_rel) - count);
+#else
+        uint64_t after = counts.fetch_sub(count, std::memory_order_release) - count;
+        if (packed_counts::Strong(after) == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return packed_counts::Strong(after);
+#endif
+    }
+
+    static size_t DecrementWeak(Counts& counts) {
+        constexpr uint64_t kOne = uint64_t{1} << packed_counts::kWeakShift;
+#ifdef __SANITIZE_THREAD__
+        return packed_counts::Weak(counts.fetch_sub(kOne, std::memory_order_acq_rel) - kOne);
+#else
+        uint64_t after = counts.fetch_sub(kOne, std::memory_order_release) - kOne;
+        if (packed_counts::Weak(after) == 0) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return packed_counts::Weak(after);
+#endif
+    }
+
+    // One CAS on the whole word: the weak half may change meanwhile, the strong one must not be 0.
+    static bool IncrementStrongIfNonZero(Counts& counts) {
+        uint64_t current = counts.load(std::memory_order_relaxed);
+        while (packed_counts::Strong(current) != 0) {
+            assert(packed_counts::Fits(packed_counts::Strong(current), 1));
+            if (counts.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel,
+                                             std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static size_t LoadStrong(const Counts& counts) {
+        return packed_counts::Strong(counts.load(std::memory_order_acquire));
+    }
+
+    static size_t LoadWeak(const Counts& counts) {
+        return packed_counts::Weak(counts.load(std::memory_order_acquire));
+    }
+
+    static uint64_t LoadCounts(const Counts& counts) {
+        return counts.load(std::memory_order_acquire);
+    }
+};
+
+#ifdef SMART_PTRS_SINGLE_THREADED
+using RefCountPolicy = SingleThreadedPolicy;
+#else
+using RefCountPolicy = AtomicPolicy;
+#endif
+
+// How a block keeps its strong count. Everything but `kShared` is opt-in per block and handled out
+// of line, so the common path only pays for one well-predicted branch.
+enum class Counting : uint8_t {
+    kShared,  // the strong half of `counts` under `RefCountPolicy`
+    kBiased,   // see `BiasedBlock`
+    kSharded,  // see `ShardedBlock`
+};
+
+class BaseBlock;
+
+// What a block is asked to do through `BaseBlock::dispatch`.
+enum class BlockOp : uint8_t {
+    kDispose,  // the strong count is gone: destroy the object, drop the owners' weak reference
+    kDestroy,  // the weak count is gone: free the block
+};
+
+// Implements `BaseBlock::dispatch` for blocks of type `Self` (see below).
+template <typename Self>
+void DispatchTo(BaseBlock* block, BlockOp op);
+
+// When a callback registered with `OnExpiry` runs, relative to the destruction of the object.
+enum class ExpiryHook : uint8_t {
+    kBeforeDestroy,
+    kAfterDestroy,
+};
+
+// Callbacks registered with `OnExpiry`, by block. Only blocks with `BaseBlock::expiry_hooks` set
+// have any, so releasing the others never gets here.
+class ExpiryRegistry {
+public:
+    using Callback = std::function<void()>;
+
+    // The caller holds a strong reference to `block`.
+    static void Add(BaseBlock* block, ExpiryHook when, Callback callback);
+
+    // Runs (and forgets) the callbacks of `block` registered for `when`. The block is disposed with
+    // `kBeforeDestroy` first and `kAfterDestroy` last, which drops its entry.
+    static void Fire(BaseBlock* block, ExpiryHook when);
+
+private:
+    struct Hook {
+        ExpiryHook when;
+        Callback callback;
+    };
+
+    struct Shared {
+        std::mutex mutex;
+        std::unordered_map<const BaseBlock*, std::vector<Hook>> hooks;
+    };
+
+    // Never destroyed: blocks may be released during static destruction.
+    static Shared& Central() {
+        static Shared* shared = new Shared();
+        return *shared;
+    }
+};
+
+// The weak count holds one extra reference on behalf of all strong owners together, so the block is
+// deleted exactly once: by whoever drops the weak count to zero.
+//
+// Blocks have no vtable. The constructor of the most derived block sets `dispatch` to
+// `DispatchTo<Self>`, which reaches `Self::Clear()` (destroys the object) and `Self::Destroy()`
+// (frees the block, plain `delete` if there is none) without further indirection.
 class BaseBlock {
 public:
+    using Dispatch = void (*)(BaseBlock* block, BlockOp op);
+
     BaseBlock(){};
-    virtual ~BaseBlock(){};
-    virtual void Clear(){};
-    size_t strong_counter = 0;
-    size_t weak_counter = 0;
+
+#ifdef SMART_PTRS_POOLED_BLOCKS
+    // Blocks come from `BlockPool` size classes; over-aligned ones go to the global heap.
+    static void* operator new(size_t size) {
+        return BlockPool::Allocate(size);
+    }
+    static void* operator new(size_t size, std::align_val_t align) {
+        return ::operator new(size, align);
+    }
+    static void operator delete(void* ptr, size_t size) {
+        BlockPool::Deallocate(ptr, size);
+    }
+    static void operator delete(void* ptr, size_t size, std::align_val_t align) {
+        ::operator delete(ptr, size, align);
+    }
+#endif
+
+    void IncStrong(size_t count = 1) {
+        if (counting != Counting::kShared) [[unlikely]] {
+            IncStrongSlow(count);
+            return;
+        }
+        RefCountPolicy::IncrementStrong(counts, count);
+    }
+
+    // Used to promote `WeakPtr`: fails if the object is already gone.
+    bool TryIncStrong() {
+        if (counting != Counting::kShared) [[unlikely]] {
+            return TryIncStrongSlow();
+        }
+        return RefCountPolicy::IncrementStrongIfNonZero(counts);
+    }
+
+    void IncWeak() {
+        RefCountPolicy::IncrementWeak(counts);
+    }
+
+    size_t StrongCount() const {
+        if (counting != Counting::kShared) [[unlikely]] {
+            return StrongCountSlow();
+        }
+        return RefCountPolicy::LoadStrong(counts);
+    }
+
+    // The caller holds the only strong reference and there are no weak ones, so nobody else can
+    // reach the block (or take a reference to it) any more. A block with expiry hooks is never
+    // unique: they are owed a call when its object goes. `expiry_hooks` is read only after the
+    // counts: once they show no other owner, the acquire load orders the read after the release of
+    // every owner that could have set it.
+    bool IsUnique() const {
+        return counting == Counting::kShared &&
+               RefCountPolicy::LoadCounts(counts) == packed_counts::kInitial && !expiry_hooks;
+    }
+
+    void ReleaseStrong(size_t count = 1) {
+        if (counting == Counting::kShared) [[likely]] {
+            if (RefCountPolicy::DecrementStrong(counts, count) != 0) [[likely]] {
+                return;
+            }
+            Dispose();
+            return;
+        }
+        if (ReleaseStrongSlow(count)) {
+            Dispose();
+        }
+    }
+
+    // Drops the strong reference of a `SharedPtr`, or queues it if the thread has a
+    // `ReleaseBuffer`. Inlined into every pointer destructor, so all it does itself is a decrement
+    // that leaves other owners; the rest is in `DropStrongCold` and in `dispatch`.
+    void DropStrong() {
+        if (ReleaseBuffer::Current() == nullptr && counting == Counting::kShared) [[likely]] {
+            if (RefCountPolicy::DecrementStrong(counts) != 0) [[likely]] {
+                return;
+            }
+            Dispose();
+            return;
+        }
+        DropStrongCold();
+    }
+
+    void ReleaseWeak() {
+        if (RefCountPolicy::DecrementWeak(counts) != 0) [[likely]] {
+            return;
+        }
+        dispatch(this, BlockOp::kDestroy);
+    }
+
+    // Called once the strong count has reached zero: destroys the object and drops the weak
+    // reference held on behalf of the strong owners.
+    void Dispose() {
+        dispatch(this, BlockOp::kDispose);
+    }
+
+    Dispatch dispatch = nullptr;
+    RefCountPolicy::Counts counts{packed_counts::kInitial};
+    Counting counting = Counting::kShared;
+    // Somebody called `OnExpiry` for this block. Only written under the `ExpiryRegistry` lock while
+    // holding a strong reference, so whoever sees that reference released (the last release, or
+    // `IsUnique` after loading the counts) sees the flag without further ordering.
+    bool expiry_hooks = false;
+
+protected:
+    // Blocks are only ever destroyed as their most derived type, see `DispatchTo`.
+    ~BaseBlock() = default;
+
+private:
+    // Out of line on purpose: only blocks with a non-default `counting` get here.
+    void IncStrongSlow(size_t count);
+    bool TryIncStrongSlow();
+    size_t StrongCountSlow() const;
+    // Returns true if the last strong reference is gone.
+    bool ReleaseStrongSlow(size_t count);
+    // `DropStrong` with a `ReleaseBuffer` or a non-default `counting`.
+    void DropStrongCold();
 };
 
-template <typename T>
-class HolderBlock : public BaseBlock {
+template <typename Self>
+void DispatchTo(BaseBlock* block, BlockOp op) {
+    Self* self = static_cast<Self*>(block);
+    if (op == BlockOp::kDispose) {
+        bool hooked = self->expiry_hooks;
+        if (hooked) [[unlikely]] {
+            ExpiryRegistry::Fire(self, ExpiryHook::kBeforeDestroy);
+        }
+        self->Clear();
+        if (hooked) [[unlikely]] {
+            ExpiryRegistry::Fire(self, ExpiryHook::kAfterDestroy);
+        }
+        // A weak reference can only be taken through another one: if ours is the last, nobody
+        // else can reach the block and the decrement is not needed.
+        if (RefCountPolicy::LoadWeak(self->counts) != 1 &&
+            RefCountPolicy::DecrementWeak(self->counts) != 0) {
+            return;
+        }
+    }
+    if constexpr (requires { self->Destroy(); }) {
+        self->Destroy();
+    } else {
+        delete self;
+    }
+}
+
+inline void ExpiryRegistry::Add(BaseBlock* block, ExpiryHook when, Callback callback) {
+    Shared& shared = Central();
+    std::lock_guard guard(shared.mutex);
+    shared.hooks[block].push_back({when, std::move(callback)});
+    block->expiry_hooks = true;
+}
+
+[[gnu::noinline]] inline void ExpiryRegistry::Fire(BaseBlock* block, ExpiryHook when) {
+    std::vector<Hook> fired;
+    {
+        Shared& shared = Central();
+        std::lock_guard guard(shared.mutex);
+        auto it = shared.hooks.find(block);
+        if (it == shared.hooks.end()) {
+            return;
+        }
+        std::vector<Hook>& hooks = it->second;
+        auto kept = std::stable_partition(hooks.begin(), hooks.end(),
+                                          [when](const Hook& hook) { return hook.when != when; });
+        fired.assign(std::make_move_iterator(kept), std::make_move_iterator(hooks.end()));
+        hooks.erase(kept, hooks.end());
+        if (when == ExpiryHook::kAfterDestroy) {
+            shared.hooks.erase(it);
+        }
+    }
+    // Outside the lock: callbacks may register hooks on other blocks or release pointers.
+    for (Hook& hook : fired) {
+        hook.callback();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Biased reference counting
+//
+// Most copies of a pointer are made on the thread that created the object, so a biased block keeps
+// two counters: `biased_count`, changed only by the owner thread with plain loads and stores, and
+// `shared_count`, an atomic counter for everybody else. The object dies once both add up to zero.
+//
+// `shared_count` stores the count shifted by one bit; the low bit (`kMerged`) is set once the
+// biased counter has been folded into it. The owner merges when its own counter reaches zero. If
+// another thread releases references the owner took (driving the shared count below zero), it
+// queues the block on the owner record and the owner merges it at its next `FlushBiasedRefCounts()`
+// or when the thread exits. After the owner thread is gone, such blocks are merged by whoever
+// queues them.
+
+struct BiasedCountingTag {};
+
+class BiasedBlock;
+
+class BiasedOwner {
+public:
+    // Record of the calling thread, created on first use.
+    static BiasedOwner* Current() {
+        if (current == nullptr) {
+            current = new BiasedOwner();
+            exit_guard.owner = current;
+        }
+        return current;
+    }
+
+    static BiasedOwner* CurrentIfAny() {
+        return current;
+    }
+
+    // Blocks keep the record of their owner alive.
+    void Acquire() {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    // Takes over a weak reference on `block`.
+    void RequestMerge(BiasedBlock* block);
+
+    // Merges every block queued by other threads.
+    void Drain();
+
+private:
+    struct ExitGuard {
+        ~ExitGuard() {
+            if (owner != nullptr) {
+                owner->exited_.store(true);
+                owner->Drain();
+                owner->Release();
+            }
+        }
+
+        BiasedOwner* owner = nullptr;
+    };
+
+    std::atomic<BiasedBlock*> queue_ = nullptr;
+    std::atomic<bool> exited_ = false;
+    std::atomic<size_t> refs_ = 1;
+
+    static thread_local BiasedOwner* current;
+    static thread_local ExitGuard exit_guard;
+};
+
+inline thread_local BiasedOwner* BiasedOwner::current = nullptr;
+inline thread_local BiasedOwner::ExitGuard BiasedOwner::exit_guard;
+
+class BiasedBlock : public BaseBlock {
+public:
+    static constexpr int64_t kMerged = 1;
+
+    BiasedBlock() : owner(BiasedOwner::Current()) {
+        counting = Counting::kBiased;
+        owner->Acquire();
+    }
+
+    ~BiasedBlock() {
+        owner->Release();
+    }
+
+    void Increment(size_t count) {
+        if (owner == BiasedOwner::CurrentIfAny()) {
+            int64_t biased = biased_count.load(std::memory_order_relaxed);
+            if (biased > 0) {
+                biased_count.store(biased + count, std::memory_order_relaxed);
+                return;
+            }
+        }
+        shared_count.fetch_add(static_cast<int64_t>(count) << 1, std::memory_order_relaxed);
+    }
+
+    bool IncrementIfNonZero() {
+        if (owner == BiasedOwner::CurrentIfAny()) {
+            int64_t biased = biased_count.load(std::memory_order_relaxed);
+            if (biased > 0) {
+                biased_count.store(biased + 1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        int64_t word = shared_count.load(std::memory_order_relaxed);
+        while (!IsZero(word)) {
+            if (shared_count.compare_exchange_weak(word, word + 2, std::memory_order_acq_rel,
+                                                   std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Returns true if the last reference is gone.
+    bool Decrement(size_t count) {
+        int64_t left = count;
+        if (owner == BiasedOwner::CurrentIfAny()) {
+            int64_t biased = biased_count.load(std::memory_order_relaxed);
+            if (biased > 0) {
+                int64_t taken = std::min(biased, left);
+                biased_count.store(biased - taken, std::memory_order_relaxed);
+                left -= taken;
+                if (biased == taken) {
+                    // The owner has dropped its counter to zero: merge it.
+                    return IsZero(AddShared(kMerged - (left << 1)));
+                }
+                if (left == 0) {
+                    if (queued.load(std::memory_order_relaxed)) {
+                        // Other threads have released references we counted: settle them now
+                        // rather than at the next flush. This may destroy the block.
+                        owner->Drain();
+                    }
+                    return false;
+                }
+            }
+        }
+
+        int64_t word = shared_count.load(std::memory_order_relaxed);
+        bool pinned = false;
+        while (true) {
+            int64_t next = word - (left << 1);
+            bool underflow = !(word & kMerged) && (next >> 1) < 0;
+            if (underflow && !pinned) {
+                // We are releasing references counted by the owner and will have to ask it to
+                // merge. Keep the block itself around until that happens.
+                IncWeak();
+                pinned = true;
+            }
+            if (shared_count.compare_exchange_weak(word, next, std::memory_order_acq_rel,
+                                                   std::memory_order_relaxed)) {
+                if (underflow) {
+                    owner->RequestMerge(this);
+                    return false;
+                }
+                if (pinned) {
+                    // Still safe: the strong owners hold their weak reference until we return.
+                    ReleaseWeak();
+                }
+                return IsZero(next);
+            }
+        }
+    }
+
+    size_t Count() const {
+        int64_t count = biased_count.load(std::memory_order_relaxed) +
+                        (shared_count.load(std::memory_order_acquire) >> 1);
+        return count > 0 ? count : 0;
+    }
+
+    // Folds what is left of the biased counter into the shared one. Only called by the owner
+    // thread or, once it has exited, by the single thread that dequeued the block.
+    // Returns true if the last reference is gone.
+    bool Merge() {
+        int64_t biased = biased_count.load(std::memory_order_relaxed);
+        if (biased == 0) {
+            // Already merged by the owner itself.
+            return false;
+        }
+        biased_count.store(0, std::memory_order_relaxed);
+        return IsZero(AddShared((biased << 1) | kMerged));
+    }
+
+    BiasedOwner* owner;
+    std::atomic<int64_t> biased_count = 1;
+    std::atomic<int64_t> shared_count = 0;
+    std::atomic<bool> queued = false;
+    BiasedBlock* next_queued = nullptr;
+
+private:
+    static bool IsZero(int64_t word) {
+        return word == kMerged;
+    }
+
+    int64_t AddShared(int64_t delta) {
+        return shared_count.fetch_add(delta, std::memory_order_acq_rel) + delta;
+    }
+};
+
+inline void BiasedOwner::RequestMerge(BiasedBlock* block) {
+    if (block->queued.exchange(true, std::memory_order_acq_rel)) {
+        block->ReleaseWeak();
+        return;
+    }
+    block->next_queued = queue_.load(std::memory_order_relaxed);
+    while (!queue_.compare_exchange_weak(block->next_queued, block)) {
+    }
+    // Pairs with the exit guard: either the owner drains after our push or we see it has exited.
+    if (exited_.load()) {
+        Drain();
+    }
+}
+
+inline void BiasedOwner::Drain() {
+    BiasedBlock* block = queue_.exchange(nullptr, std::memory_order_acq_rel);
+    while (block != nullptr) {
+        BiasedBlock* next = block->next_queued;
+        if (block->Merge()) {
+            block->Dispose();
+        }
+        block->ReleaseWeak();
+        block = next;
+    }
+}
+
+// Merges the biased counters of this thread's blocks that other threads asked to merge. Call it at
+// quiet points of long-lived threads that hand biased pointers to other threads.
+inline void FlushBiasedRefCounts() {
+    if (BiasedOwner* owner = BiasedOwner::CurrentIfAny()) {
+        owner->Drain();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sharded reference counting
+//
+// For a few very hot objects copied from every thread at once. The strong count is spread over
+// cache-line sized shards, one per thread (threads share shards round-robin), plus a `central`
+// counter holding the reference the block was created with. A thread counts its copies in its own
+// shard and releases them from there, so balanced copy/release traffic never leaves the shard.
+//
+// While the shards are open the creation reference stays in `central`, so taking one reference off
+// any non-empty shard can never drop the total to zero. A release finding every shard empty may be
+// the last one: it closes all shards, folding their counts into `central`, and from then on the
+// block counts centrally like a plain one.
+
+struct ShardedCountingTag {};
+
+class alignas(64) ShardedBlock : public BaseBlock {
+public:
+    static constexpr size_t kShards = 32;
+    static constexpr uint64_t kClosed = uint64_t{1} << 63;
+
+    ShardedBlock() {
+        counting = Counting::kSharded;
+    }
+
+    void Increment(size_t count) {
+        uint64_t old = Shard().fetch_add(count, std::memory_order_relaxed);
+        if (old & kClosed) {
+            RefCountPolicy::Increment(central, count);
+        }
+    }
+
+    bool IncrementIfNonZero() {
+        // An open shard means nobody has started releasing `central` yet: the object is alive, and
+        // our reference will be folded in by whoever closes the shard.
+        uint64_t old = Shard().fetch_add(1, std::memory_order_acq_rel);
+        if (!(old & kClosed)) {
+            return true;
+        }
+        return RefCountPolicy::IncrementIfNonZero(central);
+    }
+
+    // Returns true if the last reference is gone.
+    bool Decrement(size_t count) {
+        std::atomic<uint64_t>& own = Shard();
+        while (count != 0 && TakeFrom(own, count)) {
+        }
+        for (size_t i = 0; count != 0 && i < kShards; ++i) {
+            while (count != 0 && TakeFrom(shards[i].value, count)) {
+            }
+        }
+        if (count == 0) {
+            return false;
+        }
+        Close();
+        return RefCountPolicy::Decrement(central, count) == 0;
+    }
+
+    size_t Count() const {
+        size_t count = RefCountPolicy::Load(central);
+        for (const Slot& shard : shards) {
+            uint64_t value = shard.value.load(std::memory_order_relaxed);
+            if (!(value & kClosed)) {
+                count += value;
+            }
+        }
+        return count;
+    }
+
+    RefCountPolicy::Counter central{1};
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value = 0;
+    };
+
+    std::atomic<uint64_t>& Shard() {
+        static std::atomic<size_t> next_thread = 0;
+        thread_local size_t index = next_thread.fetch_add(1, std::memory_order_relaxed) % kShards;
+        return shards[index].value;
+    }
+
+    // Takes as many of `count` references as `shard` holds, if it is open. Returns false when
+    // there is nothing to take.
+    static bool TakeFrom(std::atomic<uint64_t>& shard, size_t& count) {
+        uint64_t value = shard.load(std::memory_order_relaxed);
+        while (value != 0 && !(value & kClosed)) {
+            uint64_t taken = std::min<uint64_t>(value, count);
+            if (shard.compare_exchange_weak(value, value - taken, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+                count -= taken;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Closing shards concurrently is fine: each one is folded in by whoever closes it first.
+    //
+    // A shard's references are added to `central` before it is seen closed, so a release that
+    // finds every shard closed also finds all of their references in `central`. If the shard
+    // changes (or someone else closes it) in between, the addition is taken back: `central` still
+    // holds the creation reference at that point, so this never brings it to zero.
+    void Close() {
+        for (Slot& shard : shards) {
+            uint64_t value = shard.value.load(std::memory_order_acquire);
+            while (!(value & kClosed)) {
+                uint64_t folded = value;
+                RefCountPolicy::Increment(central, folded);
+                if (shard.value.compare_exchange_weak(value, kClosed, std::memory_order_acq_rel,
+                                                      std::memory_order_acquire)) {
+                    break;
+                }
+                RefCountPolicy::Decrement(central, folded);
+            }
+        }
+    }
+
+    Slot shards[kShards];
+};
+
+[[gnu::noinline]] inline void BaseBlock::IncStrongSlow(size_t count) {
+    if (counting == Counting::kSharded) {
+        static_cast<ShardedBlock*>(this)->Increment(count);
+        return;
+    }
+    static_cast<BiasedBlock*>(this)->Increment(count);
+}
+
+[[gnu::noinline]] inline bool BaseBlock::TryIncStrongSlow() {
+    if (counting == Counting::kSharded) {
+        return static_cast<ShardedBlock*>(this)->IncrementIfNonZero();
+    }
+    return static_cast<BiasedBlock*>(this)->IncrementIfNonZero();
+}
+
+[[gnu::noinline]] inline size_t BaseBlock::StrongCountSlow() const {
+    if (counting == Counting::kSharded) {
+        return static_cast<const ShardedBlock*>(this)->Count();
+    }
+    return static_cast<const BiasedBlock*>(this)->Count();
+}
+
+[[gnu::noinline]] inline bool BaseBlock::ReleaseStrongSlow(size_t count) {
+    if (counting == Counting::kSharded) {
+        return static_cast<ShardedBlock*>(this)->Decrement(count);
+    }
+    return static_cast<BiasedBlock*>(this)->Decrement(count);
+}
+
+[[gnu::noinline, gnu::cold]] inline void BaseBlock::DropStrongCold() {
+    if (ReleaseBuffer* buffer = ReleaseBuffer::Current()) {
+        buffer->Push(this, [](void* target, size_t count) {
+            static_cast<BaseBlock*>(target)->ReleaseStrong(count);
+        });
+        return;
+    }
+    ReleaseStrong();
+}
+
+// Makes `HolderBlock` default-initialize the object, see `MakeSharedForOverwrite`.
+struct ForOverwriteTag {};
+
+template <typename T, typename Base = BaseBlock>
+class HolderBlock : public Base {
 public:
     HolderBlock() {
-        ++strong_counter;
         new (&storage) T();
+        this->dispatch = &DispatchTo<HolderBlock>;
+    }
+
+    explicit HolderBlock(ForOverwriteTag) {
+        new (&storage) T;
+        this->dispatch = &DispatchTo<HolderBlock>;
     }
 
     template <typename... Args>
     HolderBlock(Args&&... args) {
-        ++strong_counter;
         new (&storage) T(std::forward<Args>(args)...);
         // new (storage) T(std::forward<Args>(args)...);
+        this->dispatch = &DispatchTo<HolderBlock>;
     };
 
     T* GetPointer() {
         return reinterpret_cast<T*>(&storage);
     }
 
-    void Clear() override {
+    void Clear() {
         /*if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
             GetPointer()->weak_this.block = nullptr;
             GetPointer()->weak_this.real_object = nullptr;
@@ -46,41 +914,291 @@ public:
         GetPointer()->~T();
     }
 
-    ~HolderBlock() override {
-        // GetPointer()->~T();
+    ~HolderBlock() {
+        // GetPointer()->~T();
+    }
+
+protected:
+    // T* tp = new (alignof(T)) T;
+    alignas(T) std::array<std::byte, sizeof(T)> storage;
+};
+
+template <typename T, typename Base = BaseBlock>
+class PointerBlock : public Base {
+public:
+    PointerBlock(T* obj_pointer) {
+        object_pointer = obj_pointer;
+        this->dispatch = &DispatchTo<PointerBlock>;
+    }
+
+    T* GetPointer() {
+        return object_pointer;
+    }
+
+    // Makes the block own `ptr` instead; the caller deletes the object it returns.
+    T* Exchange(T* ptr) {
+        return std::exchange(object_pointer, ptr);
+    }
+
+    void Clear() {
+        /*if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+            object_pointer->weak_this.block = nullptr;
+            object_pointer->weak_this.real_object = nullptr;
+        }*/
+        delete object_pointer;
+        object_pointer = nullptr;
+    }
+
+    ~PointerBlock() {
+        delete object_pointer;
+        object_pointer = nullptr;
+    }
+
+protected:
+    T* object_pointer;
+};
+
+// `MakeShared` gives objects of at least this many bytes an allocation of their own, see
+// `SplitHolderBlock`. Specialize `kSplitStorage` to decide for a single type.
+constexpr size_t kSplitStorageThreshold = 4096;
+
+template <typename T>
+constexpr bool kSplitStorage = sizeof(T) >= kSplitStorageThreshold;
+
+// Object from `MakeShared` too large to share the control block's allocation (see
+// `kSplitStorage`). The object's memory is freed as soon as it is destroyed, instead of staying
+// around with the block until the last `WeakPtr` is gone.
+template <typename T>
+class SplitHolderBlock : public BaseBlock {
+public:
+    template <typename... Args>
+    SplitHolderBlock(Args&&... args) : object_pointer(new T(std::forward<Args>(args)...)) {
+        dispatch = &DispatchTo<SplitHolderBlock>;
+    }
+
+    explicit SplitHolderBlock(ForOverwriteTag) : object_pointer(new T) {
+        dispatch = &DispatchTo<SplitHolderBlock>;
+    }
+
+    T* GetPointer() {
+        return object_pointer;
+    }
+
+    void Clear() {
+        delete object_pointer;
+        object_pointer = nullptr;
+    }
+
+private:
+    T* object_pointer;
+};
+
+// Control block `MakeShared<T>` puts a single object in.
+template <typename T>
+using MakeSharedBlock = std::conditional_t<kSplitStorage<T>, SplitHolderBlock<T>, HolderBlock<T>>;
+
+// Counters, length and elements of an array from `MakeShared<T[]>` in a single allocation. Like
+// those of a built-in array, the elements are destroyed in reverse order.
+template <typename T>
+class ArrayBlock : public BaseBlock {
+public:
+    // Every element is `T(init...)`; `init` is empty or a single value to copy.
+    template <typename... Init>
+    static ArrayBlock* Create(size_t length, const Init&... init) {
+        return Build(length, [&init...](T* element) { ::new (element) T(init...); });
+    }
+
+    // Elements are default-initialized: left as they are if trivial.
+    static ArrayBlock* CreateForOverwrite(size_t length) {
+        return Build(length, [](T* element) { ::new (element) T; });
+    }
+
+    T* GetPointer() {
+        return reinterpret_cast<T*>(reinterpret_cast<std::byte*>(this) + ElementsOffset());
+    }
+
+    size_t Length() const {
+        return length_;
+    }
+
+    void Clear() {
+        T* elements = GetPointer();
+        for (size_t i = length_; i > 0; --i) {
+            elements[i - 1].~T();
+        }
+    }
+
+    void Destroy() {
+        this->~ArrayBlock();
+        Deallocate(this);
+    }
+
+private:
+    static constexpr bool kOverAligned = alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    explicit ArrayBlock(size_t length) : length_(length) {
+        dispatch = &DispatchTo<ArrayBlock>;
+    }
+
+    template <typename Construct>
+    static ArrayBlock* Build(size_t length, Construct construct) {
+        if (length > (SIZE_MAX - ElementsOffset()) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void* memory = Allocate(ElementsOffset() + length * sizeof(T));
+        ArrayBlock* block = ::new (memory) ArrayBlock(length);
+        T* elements = block->GetPointer();
+        size_t built = 0;
+        try {
+            for (; built < length; ++built) {
+                construct(elements + built);
+            }
+        } catch (...) {
+            block->length_ = built;
+            block->Clear();
+            block->~ArrayBlock();
+            Deallocate(memory);
+            throw;
+        }
+        return block;
+    }
+
+    static constexpr size_t ElementsOffset() {
+        return (sizeof(ArrayBlock) + alignof(T) - 1) / alignof(T) * alignof(T);
+    }
+
+    static void* Allocate(size_t size) {
+        if constexpr (kOverAligned) {
+            return ::operator new(size, std::align_val_t(alignof(T)));
+        } else {
+            return ::operator new(size);
+        }
+    }
+
+    static void Deallocate(void* memory) {
+        if constexpr (kOverAligned) {
+            ::operator delete(memory, std::align_val_t(alignof(T)));
+        } else {
+            ::operator delete(memory);
+        }
+    }
+
+    size_t length_;
+};
+
+// Releases the object with `D` instead of `delete`. Empty deleters take no space.
+template <typename T, typename D>
+class DeleterBlock : public BaseBlock {
+public:
+    DeleterBlock(T* ptr, D deleter) : pair_(ptr, std::move(deleter)) {
+        dispatch = &DispatchTo<DeleterBlock>;
+    }
+
+    T* GetPointer() {
+        return pair_.GetFirst();
+    }
+
+    void Clear() {
+        if (T* ptr = std::exchange(pair_.GetFirst(), nullptr)) {
+            pair_.GetSecond()(ptr);
+        }
+    }
+
+    ~DeleterBlock() {
+        DeleterBlock::Clear();
+    }
+
+private:
+    CompressedPair<T*, D> pair_;
+};
+
+// `Block` allocated by `Alloc`, which it keeps to free itself. Empty allocators take no space.
+template <typename Block, typename Alloc>
+class AllocatedBlock : public Block {
+    using BlockAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<AllocatedBlock>;
+    using Traits = std::allocator_traits<BlockAlloc>;
+
+public:
+    template <typename... Args>
+    static AllocatedBlock* Create(const Alloc& alloc, Args&&... args) {
+        BlockAlloc block_alloc(alloc);
+        AllocatedBlock* block = Traits::allocate(block_alloc, 1);
+        try {
+            ::new (block) AllocatedBlock(block_alloc, std::forward<Args>(args)...);
+        } catch (...) {
+            Traits::deallocate(block_alloc, block, 1);
+            throw;
+        }
+        return block;
+    }
+
+    void Destroy() {
+        BlockAlloc alloc(std::move(alloc_));
+        this->~AllocatedBlock();
+        Traits::deallocate(alloc, this, 1);
+    }
+
+private:
+    template <typename... Args>
+    AllocatedBlock(const BlockAlloc& alloc, Args&&... args)
+        : Block(std::forward<Args>(args)...), alloc_(alloc) {
+        this->dispatch = &DispatchTo<AllocatedBlock>;
     }
 
-protected:
-    // T* tp = new (alignof(T)) T;
-    alignas(T) std::array<std::byte, sizeof(T)> storage;
+    [[no_unique_address]] BlockAlloc alloc_;
 };
 
+template <typename T, typename Alloc>
+using AllocatedHolderBlock = AllocatedBlock<HolderBlock<T>, Alloc>;
+
+// A `HolderBlock` placed in an `Arena`: destroying it gives no memory back.
 template <typename T>
-class PointerBlock : public BaseBlock {
+class ArenaHolderBlock : public HolderBlock<T> {
 public:
-    PointerBlock(T* obj_pointer) {
-        ++strong_counter;
-        object_pointer = obj_pointer;
+    template <typename... Args>
+    ArenaHolderBlock(Args&&... args) : HolderBlock<T>(std::forward<Args>(args)...) {
+        this->dispatch = &DispatchTo<ArenaHolderBlock>;
     }
 
-    void Clear() override {
-        /*if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
-            object_pointer->weak_this.block = nullptr;
-            object_pointer->weak_this.real_object = nullptr;
-        }*/
-        delete object_pointer;
-        object_pointer = nullptr;
+    void Destroy() {
+        this->~ArenaHolderBlock();
     }
+};
 
-    ~PointerBlock() override {
-        delete object_pointer;
-        object_pointer = nullptr;
+// Opt-in for objects read through `HazardPointer` (see common/hazard_pointer.h): readers protect
+// the raw object pointer instead of copying a `SharedPtr`, and the last release retires the object
+// to the default domain rather than destroying it on the spot.
+struct HazardReclamationTag {};
+
+template <typename Block>
+class HazardBlock : public Block {
+public:
+    template <typename... Args>
+    HazardBlock(Args&&... args) : Block(std::forward<Args>(args)...) {
+        this->dispatch = &DispatchTo<HazardBlock>;
     }
 
-protected:
-    T* object_pointer;
+    void Clear() {
+        // The block has to outlive the deferred destruction.
+        this->IncWeak();
+        HazardDomain::Default().Retire(this->GetPointer(), this, [](void* ptr) {
+            HazardBlock* block = static_cast<HazardBlock*>(ptr);
+            block->Block::Clear();
+            block->ReleaseWeak();
+        });
+    }
 };
 
+// Control block of `SharedPtr(ptr, deleter, alloc)`.
+template <typename T, typename D, typename Alloc>
+BaseBlock* NewDeleterBlock(T* ptr, D deleter, const Alloc& alloc) {
+    if constexpr (std::is_convertible_v<Alloc, std::pmr::memory_resource*>) {
+        return NewDeleterBlock(ptr, std::move(deleter), std::pmr::polymorphic_allocator<T>(alloc));
+    } else {
+        return AllocatedBlock<DeleterBlock<T, D>, Alloc>::Create(alloc, ptr, std::move(deleter));
+    }
+}
+
 template <typename T>
 class SharedPtr {
 public:
@@ -100,11 +1218,121 @@ public:
     explicit SharedPtr(T* ptr) {
         block = new PointerBlock(ptr);
         real_object = ptr;
-        block->strong_counter = 1;
         if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
             ptr->weak_this.block = block;
             ptr->weak_this.real_object = real_object;
-            ++ptr->weak_this.block->weak_counter;
+            ptr->weak_this.block->IncWeak();
+        }
+    };
+
+    // Same as above, with a biased control block (see `BiasedBlock`).
+    SharedPtr(T* ptr, BiasedCountingTag) {
+        block = new PointerBlock<T, BiasedBlock>(ptr);
+        real_object = ptr;
+        if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+            ptr->weak_this.block = block;
+            ptr->weak_this.real_object = real_object;
+            ptr->weak_this.block->IncWeak();
+        }
+    };
+
+    // Same as above, with the object reclaimed through hazard pointers (see `HazardBlock`).
+    SharedPtr(T* ptr, HazardReclamationTag) {
+        block = new HazardBlock<PointerBlock<T>>(ptr);
+        real_object = ptr;
+        if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+            ptr->weak_this.block = block;
+            ptr->weak_this.real_object = real_object;
+            ptr->weak_this.block->IncWeak();
+        }
+    };
+
+    // Takes over `ptr`, which `deleter(ptr)` releases in place of `delete`. The deleter is kept in
+    // the control block, or in no space at all if it is empty.
+    template <typename U, typename D>
+        requires std::is_invocable_v<D&, U*> && std::is_convertible_v<U*, T*>
+    SharedPtr(U* ptr, D deleter) {
+        try {
+            block = new DeleterBlock<U, D>(ptr, deleter);
+        } catch (...) {
+            deleter(ptr);
+            throw;
+        }
+        real_object = ptr;
+        if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+            ptr->weak_this.block = block;
+            ptr->weak_this.real_object = real_object;
+            ptr->weak_this.block->IncWeak();
+        }
+    };
+
+    // Same as above, with the control block allocated by `alloc`, which may also be a
+    // `std::pmr::memory_resource*`.
+    template <typename U, typename D, typename Alloc>
+        requires std::is_invocable_v<D&, U*> && std::is_convertible_v<U*, T*>
+    SharedPtr(U* ptr, D deleter, const Alloc& alloc) {
+        try {
+            block = NewDeleterBlock(ptr, deleter, alloc);
+        } catch (...) {
+            deleter(ptr);
+            throw;
+        }
+        real_object = ptr;
+        if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+            ptr->weak_this.block = block;
+            ptr->weak_this.real_object = real_object;
+            ptr->weak_this.block->IncWeak();
+        }
+    };
+
+    // Takes over the object of `other` together with its deleter, which is moved into the control
+    // block (a plain `PointerBlock` if it is the default one). `other` keeps the object if this
+    // throws.
+    template <typename U, typename D>
+        requires(!std::is_array_v<U>)
+    SharedPtr(UniquePtr<U, D>&& other) {
+        U* ptr = other.Get();
+        if (ptr == nullptr) {
+            block = nullptr;
+            real_object = nullptr;
+            return;
+        }
+        if constexpr (std::is_same_v<D, Slug>) {
+            block = new PointerBlock(ptr);
+        } else {
+            block = new DeleterBlock<U, D>(ptr, std::move(other.GetDeleter()));
+        }
+        other.Release();
+        real_object = ptr;
+        if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+            ptr->weak_this.block = block;
+            ptr->weak_this.real_object = real_object;
+            ptr->weak_this.block->IncWeak();
+        }
+    };
+
+    // Same as above, with the control block allocated by `alloc`, which may also be a
+    // `std::pmr::memory_resource*` (a pool, say).
+    template <typename U, typename D, typename Alloc>
+        requires(!std::is_array_v<U>)
+    SharedPtr(UniquePtr<U, D>&& other, const Alloc& alloc) {
+        U* ptr = other.Get();
+        if (ptr == nullptr) {
+            block = nullptr;
+            real_object = nullptr;
+            return;
+        }
+        if constexpr (std::is_same_v<D, Slug>) {
+            block = NewDeleterBlock(ptr, std::default_delete<U>(), alloc);
+        } else {
+            block = NewDeleterBlock(ptr, std::move(other.GetDeleter()), alloc);
+        }
+        other.Release();
+        real_object = ptr;
+        if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+            ptr->weak_this.block = block;
+            ptr->weak_this.real_object = real_object;
+            ptr->weak_this.block->IncWeak();
         }
     };
 
@@ -112,11 +1340,10 @@ public:
     explicit SharedPtr(U* ptr) {
         block = new PointerBlock(ptr);  //
         real_object = ptr;
-        block->strong_counter = 1;
         if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
             ptr->weak_this.block = block;
             ptr->weak_this.real_object = real_object;
-            ++ptr->weak_this.block->weak_counter;
+            ptr->weak_this.block->IncWeak();
         }
     };
 
@@ -124,7 +1351,7 @@ public:
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->strong_counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -136,7 +1363,7 @@ public:
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->strong_counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -148,7 +1375,7 @@ public:
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->strong_counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -162,7 +1389,7 @@ public:
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->strong_counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -210,20 +1437,17 @@ public:
     SharedPtr(const SharedPtr<Y>& other, T* ptr) {
         block = other.block;
         real_object = ptr;
-        ++block->strong_counter;
+        block->IncStrong();
     };
 
     // Promote `WeakPtr`
     // #11 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
     explicit SharedPtr(const WeakPtr<T>& other) {
-        if (other.block != nullptr && other.block->strong_counter == 0) {
+        if (other.block != nullptr && !other.block->TryIncStrong()) {
             throw BadWeakPtr{};
         }
         block = other.block;
         real_object = other.real_object;
-        if (block != nullptr) {
-            ++block->strong_counter;
-        }
     };
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -233,88 +1457,40 @@ public:
     // Destructor
 
     ~SharedPtr() {
-        if (block == nullptr) {
-            return;
-        }
-        if (block->strong_counter > 1) {
-            --block->strong_counter;
-            block = nullptr;
-            real_object = nullptr;
-        } else {
-            if (block->weak_counter == 0) {
-                /*if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
-                    real_object->weak_this.block = nullptr;
-                    real_object->weak_this.real_object = nullptr;
-                }*/
-                block->Clear();
-                delete block;
-                block = nullptr;
-                real_object = nullptr;
-            } else {
-                --block->strong_counter;
-                /*if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
-                    real_object->weak_this.block = nullptr;
-                    real_object->weak_this.real_object = nullptr;
-                }*/
-                block->Clear();
-                if (block->weak_counter == 0) {
-                    delete block;
-                }
-                block = nullptr;
-                real_object = nullptr;
-            }
-        }
+        Reset();
     };
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Modifiers
 
     void Reset() {
-        if (block == nullptr) {
-            return;
-        }
-        if (block->strong_counter > 1) {
-            --block->strong_counter;
-            block = nullptr;
-            real_object = nullptr;
-        } else {
-            if (block->weak_counter == 0) {
-                /*if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
-                    real_object->weak_this.block = nullptr;
-                    real_object->weak_this.real_object = nullptr;
-                }*/
-                block->Clear();
-                delete block;
-                block = nullptr;
-                real_object = nullptr;
-            } else {
-                --block->strong_counter;
-                /*if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
-                    real_object->weak_this.block = nullptr;
-                    real_object->weak_this.real_object = nullptr;
-                }*/
-                block->Clear();
-                if (block->weak_counter == 0) {
-                    delete block;
-                }
-                block = nullptr;
-                real_object = nullptr;
-            }
+        // Detach first, so that the release can end in a tail call.
+        BaseBlock* released = std::exchange(block, nullptr);
+        real_object = nullptr;
+        if (released != nullptr) {
+            released->DropStrong();
         }
     };
     void Reset(T* ptr) {
-        Reset();
-        block = new PointerBlock(ptr);
-        real_object = ptr;
-        block->strong_counter = 1;
+        Reset<T>(ptr);
     };
 
+    // A uniquely owned `PointerBlock<U>` is handed the new object instead of being freed and
+    // allocated again.
     template <typename U>
     void Reset(U* ptr) {
+        if constexpr (!std::is_constructible_v<ESFTBase*, U*>) {
+            if (block != nullptr && block->dispatch == &DispatchTo<PointerBlock<U>> &&
+                block->IsUnique()) {
+                U* old = static_cast<PointerBlock<U>*>(block)->Exchange(ptr);
+                real_object = ptr;
+                delete old;
+                return;
+            }
+        }
         Reset();
         block = new PointerBlock(ptr);
         real_object = ptr;
-        block->strong_counter = 1;
     };
 
     void Swap(SharedPtr& other) {
@@ -338,7 +1514,7 @@ public:
 
     size_t UseCount() const {
         if (block != nullptr) {
-            return block->strong_counter;
+            return block->StrongCount();
         }
         return 0;
     };
@@ -358,34 +1534,287 @@ inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right) {
     return left.block == right.block;
 };
 
+// Arrays from `MakeShared<T[]>(length)` or `MakeShared<T[N]>()`. The elements live in the control
+// block (see `ArrayBlock`); the pointer keeps their count.
+template <typename T>
+class SharedPtr<T[]> {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    SharedPtr() {
+        block = nullptr;
+        real_object = nullptr;
+        length = 0;
+    };
+
+    SharedPtr(std::nullptr_t) : SharedPtr() {
+    }
+
+    SharedPtr(const SharedPtr& other) {
+        block = other.block;
+        real_object = other.real_object;
+        length = other.length;
+        if (block != nullptr) {
+            block->IncStrong();
+        }
+    };
+
+    SharedPtr& operator=(const SharedPtr& other) {
+        if (other.block != nullptr) {
+            other.block->IncStrong();
+        }
+        Reset();
+        block = other.block;
+        real_object = other.real_object;
+        length = other.length;
+        return *this;
+    }
+
+    SharedPtr(SharedPtr&& other) {
+        block = std::exchange(other.block, nullptr);
+        real_object = std::exchange(other.real_object, nullptr);
+        length = std::exchange(other.length, 0);
+    };
+
+    SharedPtr& operator=(SharedPtr&& other) {
+        SharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~SharedPtr() {
+        Reset();
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        // Detach first, so that the release can end in a tail call.
+        BaseBlock* released = std::exchange(block, nullptr);
+        real_object = nullptr;
+        length = 0;
+        if (released != nullptr) {
+            released->DropStrong();
+        }
+    };
+
+    void Swap(SharedPtr& other) {
+        std::swap(block, other.block);
+        std::swap(real_object, other.real_object);
+        std::swap(length, other.length);
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        return real_object;
+    };
+
+    T& operator[](size_t index) const {
+        return real_object[index];
+    };
+
+    size_t Size() const {
+        return length;
+    };
+
+    size_t UseCount() const {
+        if (block != nullptr) {
+            return block->StrongCount();
+        }
+        return 0;
+    };
+
+    explicit operator bool() const {
+        return real_object != nullptr;
+    };
+
+    BaseBlock* block;
+    T* real_object;
+    size_t length;
+};
+
+// Same as above, for arrays of a known size. Converts to `SharedPtr<T[]>`.
+template <typename T, size_t N>
+class SharedPtr<T[N]> : public SharedPtr<T[]> {
+public:
+    using SharedPtr<T[]>::SharedPtr;
+};
+
+// Takes over a fresh block for `MakeShared<T[]>` and friends.
+template <typename T>
+SharedPtr<T> MakeSharedArray(ArrayBlock<std::remove_extent_t<T>>* block) {
+    SharedPtr<T> ans;
+    ans.block = block;
+    ans.real_object = block->GetPointer();
+    ans.length = block->Length();
+    return ans;
+};
+
 // Allocate memory only once
 template <typename T, typename... Args>
 SharedPtr<T> MakeShared(Args&&... args) {
-    HolderBlock<T>* block = new HolderBlock<T>(std::forward<Args>(args)...);
+    using Element = std::remove_extent_t<T>;
+    if constexpr (std::is_bounded_array_v<T>) {
+        return MakeSharedArray<T>(ArrayBlock<Element>::Create(std::extent_v<T>, args...));
+    } else if constexpr (std::is_unbounded_array_v<T>) {
+        return MakeSharedArray<T>(ArrayBlock<Element>::Create(args...));
+    } else {
+        auto* block = new MakeSharedBlock<T>(std::forward<Args>(args)...);
+        SharedPtr<T> ans;
+        ans.block = block;
+        ans.real_object = block->GetPointer();
+        if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+            ans.real_object->weak_this.block = block;
+            ans.real_object->weak_this.real_object = ans.real_object;
+            ans.real_object->weak_this.block->IncWeak();
+        }
+        return ans;
+    }
+};
+
+// Same as `MakeShared`, but the object (or every element of `T[N]`) is default-initialized, so
+// buffers about to be overwritten are not zeroed first.
+template <typename T>
+SharedPtr<T> MakeSharedForOverwrite() {
+    if constexpr (std::is_bounded_array_v<T>) {
+        using Element = std::remove_extent_t<T>;
+        return MakeSharedArray<T>(ArrayBlock<Element>::CreateForOverwrite(std::extent_v<T>));
+    } else {
+        static_assert(!std::is_unbounded_array_v<T>, "MakeSharedForOverwrite<T[]> needs a length");
+        auto* block = new MakeSharedBlock<T>(ForOverwriteTag{});
+        SharedPtr<T> ans;
+        ans.block = block;
+        ans.real_object = block->GetPointer();
+        if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+            ans.real_object->weak_this.block = block;
+            ans.real_object->weak_this.real_object = ans.real_object;
+            ans.real_object->weak_this.block->IncWeak();
+        }
+        return ans;
+    }
+};
+
+// Same as above, for `length` elements of `T[]`.
+template <typename T>
+SharedPtr<T> MakeSharedForOverwrite(size_t length) {
+    static_assert(std::is_unbounded_array_v<T>, "only MakeSharedForOverwrite<T[]> takes a length");
+    return MakeSharedArray<T>(ArrayBlock<std::remove_extent_t<T>>::CreateForOverwrite(length));
+};
+
+// Same as `MakeShared`, but the block uses biased reference counting owned by the calling thread.
+template <typename T, typename... Args>
+SharedPtr<T> MakeShared(BiasedCountingTag, Args&&... args) {
+    FlushBiasedRefCounts();
+    HolderBlock<T, BiasedBlock>* block =
+        new HolderBlock<T, BiasedBlock>(std::forward<Args>(args)...);
+    SharedPtr<T> ans;
+    ans.block = block;
+    ans.real_object = block->GetPointer();
+    if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+        ans.real_object->weak_this.block = block;
+        ans.real_object->weak_this.real_object = ans.real_object;
+        ans.real_object->weak_this.block->IncWeak();
+    }
+    return ans;
+};
+
+// Same as `MakeShared`, but the block (object and counters) comes from `alloc`, which may also be
+// a `std::pmr::memory_resource*`.
+template <typename T, typename Alloc, typename... Args>
+SharedPtr<T> AllocateShared(const Alloc& alloc, Args&&... args) {
+    if constexpr (std::is_convertible_v<Alloc, std::pmr::memory_resource*>) {
+        return AllocateShared<T>(std::pmr::polymorphic_allocator<T>(alloc),
+                                 std::forward<Args>(args)...);
+    } else {
+        AllocatedHolderBlock<T, Alloc>* block =
+            AllocatedHolderBlock<T, Alloc>::Create(alloc, std::forward<Args>(args)...);
+        SharedPtr<T> ans;
+        ans.block = block;
+        ans.real_object = block->GetPointer();
+        if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+            ans.real_object->weak_this.block = block;
+            ans.real_object->weak_this.real_object = ans.real_object;
+            ans.real_object->weak_this.block->IncWeak();
+        }
+        return ans;
+    }
+};
+
+// Same as `MakeShared`, but the block comes from `arena` (see common/arena.h). The object is still
+// destroyed with its last owner; the memory goes back only when the arena is reset.
+template <typename T, typename... Args>
+SharedPtr<T> MakeSharedIn(Arena& arena, Args&&... args) {
+    void* memory = arena.Allocate(sizeof(ArenaHolderBlock<T>), alignof(ArenaHolderBlock<T>));
+    ArenaHolderBlock<T>* block = ::new (memory) ArenaHolderBlock<T>(std::forward<Args>(args)...);
+    SharedPtr<T> ans;
+    ans.block = block;
+    ans.real_object = block->GetPointer();
+    if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+        ans.real_object->weak_this.block = block;
+        ans.real_object->weak_this.real_object = ans.real_object;
+        ans.real_object->weak_this.block->IncWeak();
+    }
+    return ans;
+};
+
+// Same as above, with the strong count spread over per-thread shards (see `ShardedBlock`).
+template <typename T, typename... Args>
+SharedPtr<T> MakeShared(ShardedCountingTag, Args&&... args) {
+    HolderBlock<T, ShardedBlock>* block =
+        new HolderBlock<T, ShardedBlock>(std::forward<Args>(args)...);
+    SharedPtr<T> ans;
+    ans.block = block;
+    ans.real_object = block->GetPointer();
+    if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
+        ans.real_object->weak_this.block = block;
+        ans.real_object->weak_this.real_object = ans.real_object;
+        ans.real_object->weak_this.block->IncWeak();
+    }
+    return ans;
+};
+
+// Same as above, but the object outlives its last owner while a `HazardPointer` covers it.
+template <typename T, typename... Args>
+SharedPtr<T> MakeShared(HazardReclamationTag, Args&&... args) {
+    HazardBlock<HolderBlock<T>>* block =
+        new HazardBlock<HolderBlock<T>>(std::forward<Args>(args)...);
     SharedPtr<T> ans;
     ans.block = block;
-    block->strong_counter = 1;
     ans.real_object = block->GetPointer();
     if constexpr (std::is_constructible_v<ESFTBase*, T*>) {
         ans.real_object->weak_this.block = block;
         ans.real_object->weak_this.real_object = ans.real_object;
-        ++ans.real_object->weak_this.block->weak_counter;
+        ans.real_object->weak_this.block->IncWeak();
     }
     return ans;
 };
 
+// Calls `callback` once the last strong reference to the object `ptr` shares is gone, on the thread
+// that dropped it: just before the object is destroyed or, by default, right after. Lets an index
+// of `WeakPtr`s drop dead entries as they die instead of sweeping for them. The callback must not
+// throw; it may release `WeakPtr`s to the object. Blocks without callbacks pay one predictable
+// branch when their object dies.
+template <typename T>
+void OnExpiry(const SharedPtr<T>& ptr, std::function<void()> callback,
+              ExpiryHook when = ExpiryHook::kAfterDestroy) {
+    if (ptr.block == nullptr) {
+        throw std::invalid_argument("OnExpiry needs a non-empty pointer");
+    }
+    ExpiryRegistry::Add(ptr.block, when, std::move(callback));
+};
+
 class ESFTBase {};
 
 // Look for usage examples in tests
 template <typename T>
 class EnableSharedFromThis : public ESFTBase {
 public:
-    ~EnableSharedFromThis() {
-        --weak_this.block->weak_counter;
-        weak_this.block = nullptr;
-        weak_this.real_object = nullptr;
-    }
-
     SharedPtr<T> SharedFromThis() {
         return weak_this.Lock();
     };
@@ -0,0 +1,124 @@
+#include "atomic_shared.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("AtomicSharedPtr basics") {
+    AtomicSharedPtr<std::string> slot;
+    REQUIRE(slot.Load().Get() == nullptr);
+    REQUIRE(slot.IsLockFree());
+
+    auto first = MakeShared<std::string>("first");
+    slot.Store(first);
+    REQUIRE(first.UseCount() == 2);
+
+    auto loaded = slot.Load();
+    REQUIRE(loaded == first);
+    REQUIRE(*loaded == "first");
+    REQUIRE(first.UseCount() == 3);
+
+    auto second = MakeShared<std::string>("second");
+    auto old = slot.Exchange(second);
+    REQUIRE(old == first);
+    REQUIRE(*slot.Load() == "second");
+
+    slot.Store(nullptr);
+    REQUIRE(second.UseCount() == 1);
+    REQUIRE(first.UseCount() == 3);
+}
+
+TEST_CASE("AtomicSharedPtr CompareExchange") {
+    auto first = MakeShared<int>(1);
+    auto second = MakeShared<int>(2);
+    AtomicSharedPtr<int> slot(first);
+
+    SharedPtr<int> expected = second;
+    REQUIRE(!slot.CompareExchange(expected, MakeShared<int>(3)));
+    REQUIRE(expected == first);
+
+    REQUIRE(slot.CompareExchange(expected, second));
+    REQUIRE(slot.Load() == second);
+    REQUIRE(first.UseCount() == 2);
+
+    SharedPtr<int> empty;
+    REQUIRE(!slot.CompareExchange(empty, first));
+    REQUIRE(empty == second);
+}
+
+TEST_CASE("AtomicSharedPtr outlives many readers") {
+    auto value = MakeShared<int>(42);
+    AtomicSharedPtr<int> slot(value);
+    // More loads than a node has prepaid references, so the slot has to refill itself.
+    for (int i = 0; i < 200'000; ++i) {
+        REQUIRE(*slot.Load() == 42);
+    }
+    REQUIRE(value.UseCount() == 2);
+    slot.Store(SharedPtr<int>());
+    REQUIRE(value.UseCount() == 1);
+}
+
+TEST_CASE("AtomicWeakPtr") {
+    auto value = MakeShared<int>(7);
+    WeakPtr<int> weak(value);
+    AtomicWeakPtr<int> slot(weak);
+    REQUIRE(*slot.Load().Lock() == 7);
+    REQUIRE(value.UseCount() == 1);
+
+    value.Reset();
+    REQUIRE(slot.Load().Expired());
+}
+
+TEST_CASE("AtomicSharedPtr concurrent readers and writers") {
+    constexpr int kReaders = 4;
+    constexpr int kWrites = 2'000;
+
+    AtomicSharedPtr<std::vector<int>> slot(MakeShared<std::vector<int>>(16, 0));
+    std::atomic<bool> done = false;
+    // Catch assertions are not thread-safe: threads count failures instead.
+    std::atomic<int> torn = 0;
+    std::atomic<int> failed_exchanges = 0;
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < kReaders; ++i) {
+        readers.emplace_back([&slot, &done, &torn] {
+            while (!done) {
+                auto table = slot.Load();
+                int first = table->front();
+                for (int value : *table) {
+                    if (value != first) {
+                        torn.fetch_add(1);
+                    }
+                }
+            }
+        });
+    }
+
+    std::thread writer([&slot, &failed_exchanges] {
+        for (int i = 1; i <= kWrites; ++i) {
+            if (i % 2 == 0) {
+                slot.Store(MakeShared<std::vector<int>>(16, i));
+            } else {
+                auto expected = slot.Load();
+                if (!slot.CompareExchange(expected, MakeShared<std::vector<int>>(16, i))) {
+                    failed_exchanges.fetch_add(1);
+                }
+            }
+        }
+    });
+
+    writer.join();
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    REQUIRE(torn == 0);
+    REQUIRE(failed_exchanges == 0);
+    REQUIRE(slot.Load()->front() == kWrites);
+    REQUIRE(slot.Load().UseCount() == 2);
+}
@@ -0,0 +1,163 @@
+#include "compact_shared.h"
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Pair {
+    int first = 1;
+    int second = 2;
+};
+
+struct Node : EnableSharedFromThis<Node> {
+    int value = 0;
+};
+
+}  // namespace
+
+TEST_CASE("CompactSharedPtr basics") {
+    static_assert(sizeof(CompactSharedPtr<std::string>) == sizeof(void*));
+
+    CompactSharedPtr<std::string> empty;
+    REQUIRE(empty.Get() == nullptr);
+    REQUIRE(!empty);
+    REQUIRE(empty.UseCount() == 0);
+
+    auto ptr = MakeCompactShared<std::string>("compact");
+    REQUIRE(*ptr == "compact");
+    REQUIRE(ptr->size() == 7);
+    REQUIRE(ptr.UseCount() == 1);
+
+    auto copy = ptr;
+    REQUIRE(copy == ptr);
+    REQUIRE(ptr.UseCount() == 2);
+
+    CompactSharedPtr<std::string> moved(std::move(copy));
+    REQUIRE(copy.Get() == nullptr);
+    REQUIRE(ptr.UseCount() == 2);
+
+    moved = moved;
+    REQUIRE(ptr.UseCount() == 2);
+    moved = std::move(empty);
+    REQUIRE(moved.Get() == nullptr);
+    REQUIRE(ptr.UseCount() == 1);
+
+    moved.Swap(ptr);
+    REQUIRE(*moved == "compact");
+    REQUIRE(ptr.Get() == nullptr);
+
+    EXPECT_ZERO_ALLOCATIONS(auto another = moved);
+}
+
+TEST_CASE("CompactSharedPtr and SharedPtr") {
+    SECTION("From MakeShared") {
+        auto shared = MakeShared<std::string>("value");
+        REQUIRE(CompactSharedPtr<std::string>::Fits(shared));
+
+        CompactSharedPtr<std::string> compact(shared);
+        REQUIRE(compact.Get() == shared.Get());
+        REQUIRE(shared.UseCount() == 2);
+
+        CompactSharedPtr<std::string> stolen(std::move(shared));
+        REQUIRE(shared.Get() == nullptr);
+        REQUIRE(compact.UseCount() == 2);
+
+        SharedPtr<std::string> back = compact;
+        REQUIRE(back.Get() == compact.Get());
+        REQUIRE(compact.UseCount() == 3);
+
+        SharedPtr<std::string> moved_back = std::move(stolen);
+        REQUIRE(stolen.Get() == nullptr);
+        REQUIRE(compact.UseCount() == 3);
+
+        EXPECT_ZERO_ALLOCATIONS(CompactSharedPtr<std::string> again(moved_back));
+    }
+
+    SECTION("Empty") {
+        SharedPtr<int> shared;
+        REQUIRE(CompactSharedPtr<int>::Fits(shared));
+        CompactSharedPtr<int> compact(shared);
+        REQUIRE(compact.Get() == nullptr);
+        SharedPtr<int> back = compact;
+        REQUIRE(back.Get() == nullptr);
+    }
+
+    SECTION("Pointers that do not fit") {
+        SharedPtr<int> from_pointer(new int(1));
+        REQUIRE(!CompactSharedPtr<int>::Fits(from_pointer));
+        REQUIRE_THROWS_AS(CompactSharedPtr<int>(from_pointer), std::invalid_argument);
+        REQUIRE(from_pointer.UseCount() == 1);
+
+        auto pair = MakeShared<Pair>();
+        SharedPtr<int> aliased(pair, &pair->second);
+        REQUIRE(!CompactSharedPtr<int>::Fits(aliased));
+        REQUIRE_THROWS_AS(CompactSharedPtr<int>(std::move(aliased)), std::invalid_argument);
+        REQUIRE(aliased.Get() == &pair->second);
+
+        std::pmr::monotonic_buffer_resource resource;
+        auto allocated = AllocateShared<int>(&resource, 3);
+        REQUIRE(!CompactSharedPtr<int>::Fits(allocated));
+    }
+}
+
+TEST_CASE("CompactSharedPtr and WeakPtr") {
+    auto compact = MakeCompactShared<std::string>("weak");
+    WeakPtr<std::string> weak = compact;
+    REQUIRE(!weak.Expired());
+    REQUIRE(CompactSharedPtr<std::string>::Fits(weak));
+    REQUIRE(weak.Lock().Get() == compact.Get());
+
+    CompactSharedPtr<std::string> locked(weak);
+    REQUIRE(*locked == "weak");
+    REQUIRE(compact.UseCount() == 2);
+
+    compact.Reset();
+    locked.Reset();
+    REQUIRE(weak.Expired());
+    REQUIRE_THROWS_AS(CompactSharedPtr<std::string>(weak), BadWeakPtr);
+}
+
+TEST_CASE("CompactSharedPtr with EnableSharedFromThis") {
+    auto compact = MakeCompactShared<Node>();
+    SharedPtr<Node> shared = compact->SharedFromThis();
+    REQUIRE(shared.Get() == compact.Get());
+    REQUIRE(compact.UseCount() == 2);
+    REQUIRE(CompactSharedPtr<Node>(compact->WeakFromThis()) == compact);
+}
+
+TEST_CASE("Many CompactSharedPtrs") {
+    auto first = MakeCompactShared<int>(1);
+    std::vector<CompactSharedPtr<int>> ptrs(1000, first);
+    REQUIRE(first.UseCount() == 1001);
+    ptrs.clear();
+    REQUIRE(first.UseCount() == 1);
+}
+
+TEST_CASE("CompactSharedPtr to a large object") {
+    struct Large {
+        std::string name;
+        char data[kSplitStorageThreshold] = {};
+    };
+
+    auto compact = MakeCompactShared<Large>("large");
+    REQUIRE(compact->name == "large");
+    WeakPtr<Large> weak = compact;
+    SharedPtr<Large> shared = compact;
+    REQUIRE(CompactSharedPtr<Large>::Fits(shared));
+    REQUIRE(CompactSharedPtr<Large>(weak) == compact);
+
+    shared.Reset();
+    compact.Reset();
+    REQUIRE(weak.Expired());
+    REQUIRE_THROWS_AS(CompactSharedPtr<Large>(weak), BadWeakPtr);
+}
@@ -0,0 +1,114 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SMART_PTRS_POOLED_BLOCKS
+#error "test_pooled.cpp must be built with SMART_PTRS_POOLED_BLOCKS"
+#endif
+
+namespace {
+
+struct Counted {
+    Counted(std::atomic<int>* destroyed) : destroyed(destroyed) {
+    }
+
+    ~Counted() {
+        destroyed->fetch_add(1);
+    }
+
+    std::atomic<int>* destroyed;
+};
+
+}  // namespace
+
+TEST_CASE("Pooled blocks are reused") {
+    // Warm up the thread cache for both block kinds.
+    {
+        SharedPtr<int> first(new int(1));
+        auto second = MakeShared<int>(2);
+    }
+
+    SECTION("From pointer") {
+        int* value = new int(3);
+        EXPECT_ZERO_ALLOCATIONS(SharedPtr<int> ptr(value));
+    }
+    SECTION("MakeShared") {
+        EXPECT_ZERO_ALLOCATIONS(REQUIRE(*MakeShared<int>(4) == 4));
+    }
+    SECTION("Reset") {
+        SharedPtr<int> ptr(new int(5));
+        int* value = new int(6);
+        EXPECT_ZERO_ALLOCATIONS(ptr.Reset(value));
+        REQUIRE(*ptr == 6);
+    }
+    SECTION("Large objects bypass the pool") {
+        struct Large {
+            char data[BlockPool::kMaxSize] = {};
+        };
+        EXPECT_ONE_ALLOCATION(MakeShared<Large>());
+    }
+}
+
+TEST_CASE("Pooled block outlives strong references") {
+    std::atomic<int> destroyed = 0;
+    WeakPtr<Counted> weak;
+    {
+        auto shared = MakeShared<Counted>(&destroyed);
+        weak = shared;
+        REQUIRE(!weak.Expired());
+    }
+    REQUIRE(destroyed == 1);
+    REQUIRE(weak.Expired());
+    REQUIRE(weak.Lock().Get() == nullptr);
+
+    WeakPtr<std::string> weak_string;
+    {
+        SharedPtr<std::string> shared(new std::string("pooled"));
+        weak_string = shared;
+    }
+    REQUIRE(weak_string.Expired());
+}
+
+TEST_CASE("Pooled blocks freed on other threads") {
+    constexpr int kThreads = 4;
+    constexpr int kObjects = 10'000;
+
+    std::atomic<int> destroyed = 0;
+    std::vector<std::vector<SharedPtr<Counted>>> batches(kThreads);
+    for (auto& batch : batches) {
+        for (int i = 0; i < kObjects; ++i) {
+            batch.push_back(MakeShared<Counted>(&destroyed));
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (auto& batch : batches) {
+        threads.emplace_back([&batch] {
+            batch.clear();
+            // Blocks freed here go back to the shared lists when the thread exits.
+            for (int i = 0; i < kObjects; ++i) {
+                SharedPtr<int> local(new int(i));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(destroyed == kThreads * kObjects);
+
+    std::vector<SharedPtr<int>> reused;
+    for (int i = 0; i < kThreads * kObjects; ++i) {
+        reused.push_back(MakeShared<int>(i));
+    }
+    REQUIRE(*reused.back() == kThreads * kObjects - 1);
+}
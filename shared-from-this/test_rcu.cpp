@@ -0,0 +1,118 @@
+#include "rcu_cell.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Route {
+    Route(int version, std::atomic<int>* destroyed) : version(version), destroyed(destroyed) {
+    }
+
+    ~Route() {
+        destroyed->fetch_add(1);
+    }
+
+    int version;
+    std::atomic<int>* destroyed;
+};
+
+struct Snapshot {
+    explicit Snapshot(int version) : version(version) {
+    }
+
+    int version;
+    char data[kSplitStorageThreshold] = {};
+};
+
+}  // namespace
+
+TEST_CASE("RcuCell basics") {
+    RcuCell<std::string> cell("first");
+    REQUIRE(*cell.Read() == "first");
+    REQUIRE(cell.Read()->size() == 5);
+
+    SharedPtr<std::string> kept = cell.Load();
+    cell.Publish("second");
+    REQUIRE(*cell.Read() == "second");
+    REQUIRE(*kept == "first");
+
+    EpochDomain::Default().Synchronize();
+    REQUIRE(kept.UseCount() == 1);
+}
+
+TEST_CASE("RcuCell keeps versions alive while read") {
+    std::atomic<int> destroyed = 0;
+    {
+        RcuCell<Route> cell(0, &destroyed);
+        {
+            auto guard = cell.Read();
+            cell.Publish(1, &destroyed);
+            cell.Publish(2, &destroyed);
+            REQUIRE(guard->version == 0);
+            REQUIRE(cell.Read()->version == 2);
+            REQUIRE(destroyed == 0);
+        }
+        EpochDomain::Default().Synchronize();
+        REQUIRE(destroyed == 2);
+    }
+    REQUIRE(destroyed == 3);
+}
+
+TEST_CASE("RcuCell of a large value") {
+    static_assert(kSplitStorage<Snapshot>);
+    RcuCell<Snapshot> cell(1);
+    REQUIRE(cell.Read()->version == 1);
+
+    SharedPtr<Snapshot> kept = cell.Load();
+    cell.Publish(2);
+    REQUIRE(cell.Read()->version == 2);
+    REQUIRE(kept->version == 1);
+    REQUIRE(kept->data[kSplitStorageThreshold - 1] == 0);
+
+    EpochDomain::Default().Synchronize();
+    REQUIRE(kept.UseCount() == 1);
+}
+
+TEST_CASE("RcuCell concurrent readers") {
+    constexpr int kReaders = 4;
+    constexpr int kVersions = 20'000;
+
+    std::atomic<int> destroyed = 0;
+    {
+        RcuCell<Route> cell(0, &destroyed);
+        std::atomic<bool> stop = false;
+        std::atomic<int> stale = 0;
+
+        std::vector<std::thread> readers;
+        for (int i = 0; i < kReaders; ++i) {
+            readers.emplace_back([&] {
+                int last = 0;
+                while (!stop.load()) {
+                    auto guard = cell.Read();
+                    if (guard->version < last) {
+                        stale.fetch_add(1);
+                    }
+                    last = guard->version;
+                }
+            });
+        }
+        for (int version = 1; version <= kVersions; ++version) {
+            cell.Publish(version, &destroyed);
+        }
+        stop.store(true);
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        REQUIRE(stale == 0);
+        EpochDomain::Default().Synchronize();
+        REQUIRE(destroyed == kVersions);
+    }
+    REQUIRE(destroyed == kVersions + 1);
+}
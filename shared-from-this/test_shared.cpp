@@ -1,10 +1,18 @@
 #include "shared.h"
+#include "weak.h"
 
 #include <catch.hpp>
 
 #include "allocations_checker.h"
 
+#include <array>
+#include <cstdint>
+#include <cstdlib>
 #include <memory>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -467,3 +475,505 @@ TEST_CASE("Destructor for correct type") {
         REQUIRE(B::destructor_called);
     }
 }
+
+TEST_CASE("Release buffer") {
+    struct Node {
+        SharedPtr<Node> next;
+    };
+
+    SECTION("Coalesced and flushed at scope exit") {
+        auto shared = MakeShared<int>(42);
+        std::vector<SharedPtr<int>> copies(3000, shared);
+        {
+            ReleaseBuffer buffer;
+            copies.clear();
+            REQUIRE(shared.UseCount() > 1);
+        }
+        REQUIRE(shared.UseCount() == 1);
+
+        WeakPtr<int> weak = shared;
+        {
+            ReleaseBuffer buffer;
+            shared.Reset();
+            REQUIRE(!weak.Expired());
+        }
+        REQUIRE(weak.Expired());
+    }
+
+    SECTION("Destructors releasing more pointers") {
+        SharedPtr<Node> head;
+        for (int i = 0; i < 100'000; ++i) {
+            SharedPtr<Node> node = MakeShared<Node>();
+            node->next = std::move(head);
+            head = std::move(node);
+        }
+        WeakPtr<Node> tail = head;
+        while (tail.Lock()->next) {
+            tail = tail.Lock()->next;
+        }
+        {
+            ReleaseBuffer buffer;
+            head.Reset();
+        }
+        REQUIRE(tail.Expired());
+    }
+}
+
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator(int* live) : live(live) {
+    }
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& other) : live(other.live) {
+    }
+
+    T* allocate(size_t count) {
+        ++*live;
+        return std::allocator<T>().allocate(count);
+    }
+
+    void deallocate(T* ptr, size_t count) {
+        --*live;
+        std::allocator<T>().deallocate(ptr, count);
+    }
+
+    bool operator==(const CountingAllocator& other) const {
+        return live == other.live;
+    }
+
+    int* live;
+};
+
+TEST_CASE("AllocateShared") {
+    static_assert(sizeof(AllocatedHolderBlock<int, std::allocator<int>>) ==
+                  sizeof(HolderBlock<int>));
+
+    SECTION("Allocator") {
+        int live = 0;
+        {
+            auto ptr = AllocateShared<std::string>(CountingAllocator<int>(&live), "allocated");
+            WeakPtr<std::string> weak = ptr;
+            REQUIRE(live == 1);
+            REQUIRE(*ptr == "allocated");
+            ptr.Reset();
+            REQUIRE(live == 1);
+        }
+        REQUIRE(live == 0);
+    }
+
+    SECTION("Memory resource") {
+        std::array<std::byte, 1024> buffer;
+        std::pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size(),
+                                                     std::pmr::null_memory_resource());
+        using Pair = std::pair<int, int>;
+        EXPECT_ZERO_ALLOCATIONS(auto first = AllocateShared<int>(&resource, 1);
+                                auto second = AllocateShared<Pair>(&resource, 2, 3);
+                                REQUIRE(*first == 1); REQUIRE(second->second == 3););
+    }
+}
+
+TEST_CASE("MakeSharedIn") {
+    struct Live {
+        Live(int* live) : live(live) {
+            ++*live;
+        }
+        ~Live() {
+            --*live;
+        }
+        int* live;
+    };
+
+    Arena arena({.chunk_size = 4096, .huge_pages = false, .prefault = true});
+
+    SECTION("Objects") {
+        using Pair = std::pair<int, int>;
+        auto first = MakeSharedIn<int>(arena, 1);
+        EXPECT_ZERO_ALLOCATIONS(auto second = MakeSharedIn<Pair>(arena, 2, 3);
+                                auto copy = second; REQUIRE(copy->first == 2););
+        REQUIRE(*first == 1);
+        REQUIRE(arena.Capacity() == 4096);
+    }
+
+    SECTION("Weak outlives the object") {
+        int live = 0;
+        WeakPtr<Live> weak;
+        {
+            auto ptr = MakeSharedIn<Live>(arena, &live);
+            weak = ptr;
+            REQUIRE(live == 1);
+        }
+        REQUIRE(live == 0);
+        REQUIRE(weak.Expired());
+    }
+
+    SECTION("Reuse after reset") {
+        std::vector<SharedPtr<std::string>> strings;
+        for (int i = 0; i < 1000; ++i) {
+            strings.push_back(MakeSharedIn<std::string>(arena, "string"));
+        }
+        size_t capacity = arena.Capacity();
+        REQUIRE(capacity > 4096);
+        strings.clear();
+        arena.Reset();
+        for (int i = 0; i < 1000; ++i) {
+            strings.push_back(MakeSharedIn<std::string>(arena, "string"));
+        }
+        REQUIRE(arena.Capacity() == capacity);
+        strings.clear();
+    }
+
+    SECTION("Oversized") {
+        auto big = MakeSharedIn<std::array<char, 10'000>>(arena);
+        REQUIRE(arena.Capacity() >= 10'000);
+    }
+}
+
+struct Tracked {
+    Tracked() : id(next++) {
+    }
+    ~Tracked() {
+        destroyed.push_back(id);
+    }
+    int id;
+
+    static inline int next = 0;
+    static inline std::vector<int> destroyed;
+};
+
+struct Flaky {
+    Flaky() {
+        if (++built == 3) {
+            throw std::runtime_error("third");
+        }
+    }
+    ~Flaky() {
+        ++destroyed;
+    }
+
+    static inline int built = 0;
+    static inline int destroyed = 0;
+};
+
+TEST_CASE("Arrays") {
+    SECTION("Unbounded") {
+        SharedPtr<int[]> empty;
+        REQUIRE(!empty);
+        REQUIRE(empty.Size() == 0);
+
+        EXPECT_ONE_ALLOCATION(auto ptr = MakeShared<int[]>(5, 7); REQUIRE(ptr.Size() == 5);
+                              REQUIRE(ptr[4] == 7););
+        auto zeros = MakeShared<int[]>(3);
+        REQUIRE(zeros[0] == 0);
+        REQUIRE(zeros[2] == 0);
+
+        auto strings = MakeShared<std::string[]>(2, "init");
+        SharedPtr<std::string[]> copy = strings;
+        copy[1] = "changed";
+        REQUIRE(strings[1] == "changed");
+        REQUIRE(strings.UseCount() == 2);
+        copy = std::move(strings);
+        REQUIRE(copy.UseCount() == 1);
+        REQUIRE(!strings);
+    }
+
+    SECTION("Bounded") {
+        auto ptr = MakeShared<std::string[3]>("x");
+        REQUIRE(ptr.Size() == 3);
+        REQUIRE(ptr[2] == "x");
+        SharedPtr<std::string[]> unbounded = ptr;
+        REQUIRE(unbounded.Size() == 3);
+        REQUIRE(unbounded == ptr);
+    }
+
+    SECTION("Destruction order") {
+        Tracked::next = 0;
+        Tracked::destroyed.clear();
+        MakeShared<Tracked[]>(3);
+        REQUIRE(Tracked::destroyed == std::vector<int>{2, 1, 0});
+    }
+
+    SECTION("Throwing element") {
+        REQUIRE_THROWS_AS(MakeShared<Flaky[]>(5), std::runtime_error);
+        REQUIRE(Flaky::destroyed == 2);
+    }
+
+    SECTION("Length too large") {
+        size_t length = SIZE_MAX / sizeof(int) + 1;
+        EXPECT_ZERO_ALLOCATIONS(
+            REQUIRE_THROWS_AS(MakeShared<int[]>(length), std::bad_array_new_length));
+        REQUIRE_THROWS_AS(MakeSharedForOverwrite<int[]>(SIZE_MAX), std::bad_array_new_length);
+    }
+}
+
+TEST_CASE("MakeSharedForOverwrite") {
+    SECTION("Scalar") {
+        // Below `kSplitStorageThreshold`, so the buffer shares the control block's allocation.
+        using Buffer = std::array<char, 1024>;
+        EXPECT_ONE_ALLOCATION(auto ptr = MakeSharedForOverwrite<Buffer>();
+                              (*ptr)[1023] = 'x'; REQUIRE((*ptr)[1023] == 'x'););
+        REQUIRE(MakeSharedForOverwrite<std::string>()->empty());
+    }
+
+    SECTION("Arrays") {
+        EXPECT_ONE_ALLOCATION(auto ptr = MakeSharedForOverwrite<char[]>(1 << 16);
+                              REQUIRE(ptr.Size() == 1 << 16); ptr[0] = 'x';);
+        auto strings = MakeSharedForOverwrite<std::string[3]>();
+        REQUIRE(strings.Size() == 3);
+        REQUIRE(strings[2].empty());
+
+        Tracked::next = 0;
+        Tracked::destroyed.clear();
+        MakeSharedForOverwrite<Tracked[]>(3);
+        REQUIRE(Tracked::destroyed == std::vector<int>{2, 1, 0});
+    }
+}
+
+TEST_CASE("Custom deleters") {
+    struct FreeDelete {
+        void operator()(void* ptr) const {
+            std::free(ptr);
+        }
+    };
+    static_assert(sizeof(DeleterBlock<int, FreeDelete>) == sizeof(PointerBlock<int>));
+
+    SECTION("Empty") {
+        int* value = static_cast<int*>(std::malloc(sizeof(int)));
+        *value = 5;
+        SharedPtr<int> ptr;
+        EXPECT_ONE_ALLOCATION(ptr = SharedPtr<int>(value, FreeDelete{}));
+        REQUIRE(*ptr == 5);
+    }
+
+    SECTION("Stateful") {
+        int deleted = 0;
+        auto deleter = [&deleted](std::string* ptr) {
+            ++deleted;
+            delete ptr;
+        };
+        {
+            SharedPtr<std::string> ptr(new std::string("custom"), deleter);
+            WeakPtr<std::string> weak = ptr;
+            auto copy = ptr;
+            ptr.Reset();
+            REQUIRE(deleted == 0);
+            copy.Reset();
+            REQUIRE(deleted == 1);
+            REQUIRE(weak.Expired());
+        }
+        REQUIRE(deleted == 1);
+    }
+
+    SECTION("Allocator") {
+        int live = 0;
+        int deleted = 0;
+        {
+            int value = 7;
+            auto deleter = [&deleted](int*) { ++deleted; };
+            SharedPtr<int> ptr(&value, deleter, CountingAllocator<int>(&live));
+            REQUIRE(live == 1);
+            REQUIRE(*ptr == 7);
+        }
+        REQUIRE(deleted == 1);
+        REQUIRE(live == 0);
+
+        std::array<std::byte, 256> buffer;
+        std::pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size(),
+                                                     std::pmr::null_memory_resource());
+        int value = 8;
+        EXPECT_ZERO_ALLOCATIONS(SharedPtr<int> ptr(&value, [](int*) {}, &resource););
+    }
+}
+
+TEST_CASE("Packed counts") {
+    static_assert(sizeof(HolderBlock<int>) <= 3 * sizeof(void*));
+
+    auto ptr = MakeShared<int>(1);
+    std::vector<SharedPtr<int>> strong(1000, ptr);
+    std::vector<WeakPtr<int>> weak(2000, ptr);
+    REQUIRE(ptr.UseCount() == 1001);
+    strong.clear();
+    REQUIRE(ptr.UseCount() == 1);
+    REQUIRE(weak.back().UseCount() == 1);
+    ptr.Reset();
+    REQUIRE(weak.front().Expired());
+    REQUIRE(weak.front().Lock().Get() == nullptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Reset reuses a uniquely owned block") {
+    SECTION("Only owner") {
+        SharedPtr<std::string> ptr(new std::string("first"));
+        BaseBlock* block = ptr.block;
+        auto* value = new std::string("second");
+        EXPECT_ZERO_ALLOCATIONS(ptr.Reset(value));
+        REQUIRE(ptr.block == block);
+        REQUIRE(ptr.Get() == value);
+        REQUIRE(*ptr == "second");
+        REQUIRE(ptr.UseCount() == 1);
+    }
+    SECTION("Shared with a copy") {
+        SharedPtr<std::string> ptr(new std::string("first"));
+        auto copy = ptr;
+        auto* value = new std::string("second");
+        EXPECT_ONE_ALLOCATION(ptr.Reset(value));
+        REQUIRE(*copy == "first");
+        REQUIRE(*ptr == "second");
+        REQUIRE(copy.UseCount() == 1);
+    }
+    SECTION("Observed by a weak pointer") {
+        SharedPtr<std::string> ptr(new std::string("first"));
+        WeakPtr<std::string> weak = ptr;
+        auto* value = new std::string("second");
+        EXPECT_ONE_ALLOCATION(ptr.Reset(value));
+        REQUIRE(weak.Expired());
+        REQUIRE(*ptr == "second");
+    }
+    SECTION("Other blocks are not reused") {
+        auto ptr = MakeShared<std::string>("first");
+        auto* value = new std::string("second");
+        EXPECT_ONE_ALLOCATION(ptr.Reset(value));
+        REQUIRE(*ptr == "second");
+
+        SharedPtr<std::string> deleted(new std::string("third"),
+                                       std::default_delete<std::string>());
+        value = new std::string("fourth");
+        EXPECT_ONE_ALLOCATION(deleted.Reset(value));
+        REQUIRE(*deleted == "fourth");
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Huge {
+    Huge() {
+        ++alive;
+    }
+    ~Huge() {
+        --alive;
+    }
+
+    static inline int alive = 0;
+    char data[kSplitStorageThreshold];
+};
+
+struct HugeButInline {
+    char data[kSplitStorageThreshold];
+};
+
+}  // namespace
+
+template <>
+constexpr bool kSplitStorage<HugeButInline> = false;
+
+TEST_CASE("Large objects outside the control block") {
+    SECTION("Storage goes away with the last strong reference") {
+        WeakPtr<Huge> weak;
+        {
+            auto ptr = MakeShared<Huge>();
+            REQUIRE(ptr.block->dispatch == &DispatchTo<SplitHolderBlock<Huge>>);
+            REQUIRE(Huge::alive == 1);
+            weak = ptr;
+            auto copy = weak.Lock();
+            REQUIRE(copy.Get() == ptr.Get());
+        }
+        REQUIRE(Huge::alive == 0);
+        REQUIRE(weak.Expired());
+        REQUIRE(weak.Lock().Get() == nullptr);
+    }
+    SECTION("For overwrite") {
+        auto ptr = MakeSharedForOverwrite<Huge>();
+        REQUIRE(ptr.block->dispatch == &DispatchTo<SplitHolderBlock<Huge>>);
+        REQUIRE(Huge::alive == 1);
+    }
+    SECTION("Small objects and opted-out types stay inline") {
+        auto small = MakeShared<int>(1);
+        REQUIRE(small.block->dispatch == &DispatchTo<HolderBlock<int>>);
+        EXPECT_ONE_ALLOCATION(MakeShared<HugeButInline>());
+        auto inline_huge = MakeShared<HugeButInline>();
+        REQUIRE(inline_huge.block->dispatch == &DispatchTo<HolderBlock<HugeButInline>>);
+    }
+    REQUIRE(Huge::alive == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("From UniquePtr") {
+    SECTION("Default deleter") {
+        UniquePtr<std::string> unique(new std::string("unique"));
+        std::string* object = unique.Get();
+        EXPECT_ONE_ALLOCATION(SharedPtr<std::string> shared(std::move(unique));
+                              REQUIRE(shared.Get() == object));
+        REQUIRE(unique.Get() == nullptr);
+
+        SharedPtr<std::string> shared(UniquePtr<std::string>(new std::string("temporary")));
+        REQUIRE(*shared == "temporary");
+        REQUIRE(shared.UseCount() == 1);
+    }
+
+    SECTION("Arena objects") {
+        Arena arena;
+        SharedPtr<std::string> shared(MakeUniqueIn<std::string>(arena, "arena"));
+        REQUIRE(*shared == "arena");
+    }
+
+    SECTION("Deleter moves into the block") {
+        int deleted = 0;
+        struct CountingDelete {
+            void operator()(int* ptr) const {
+                if (ptr != nullptr) {
+                    ++*deleted;
+                    delete ptr;
+                }
+            }
+            int* deleted = nullptr;
+        };
+
+        UniquePtr<int, CountingDelete> unique(new int(5), CountingDelete{&deleted});
+        SharedPtr<int> shared(std::move(unique));
+        REQUIRE(unique.Get() == nullptr);
+        REQUIRE(*shared == 5);
+        auto copy = shared;
+        shared.Reset();
+        REQUIRE(deleted == 0);
+        copy.Reset();
+        REQUIRE(deleted == 1);
+    }
+
+    SECTION("Stateless deleters take no space") {
+        struct FreeDelete {
+            void operator()(void* ptr) const {
+                std::free(ptr);
+            }
+        };
+        int* raw = static_cast<int*>(std::malloc(sizeof(int)));
+        UniquePtr<int, FreeDelete> unique(raw);
+        SharedPtr<int> shared(std::move(unique));
+        REQUIRE(shared.Get() == raw);
+        REQUIRE(sizeof(DeleterBlock<int, FreeDelete>) == sizeof(PointerBlock<int>));
+    }
+
+    SECTION("Block from a memory resource") {
+        std::array<std::byte, 256> buffer;
+        std::pmr::monotonic_buffer_resource resource(buffer.data(), buffer.size(),
+                                                     std::pmr::null_memory_resource());
+        UniquePtr<std::string> unique(new std::string("pooled"));
+        EXPECT_ZERO_ALLOCATIONS(SharedPtr<std::string> shared(std::move(unique), &resource);
+                                REQUIRE(*shared == "pooled");
+                                auto* block = reinterpret_cast<std::byte*>(shared.block);
+                                REQUIRE(block >= buffer.data());
+                                REQUIRE(block < buffer.data() + buffer.size()));
+        REQUIRE(unique.Get() == nullptr);
+    }
+
+    SECTION("Empty") {
+        UniquePtr<int> unique;
+        EXPECT_ZERO_ALLOCATIONS(SharedPtr<int> shared(std::move(unique));
+                                REQUIRE(shared.Get() == nullptr));
+    }
+}
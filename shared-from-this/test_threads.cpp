@@ -0,0 +1,284 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Counted {
+    Counted(std::atomic<int>* destroyed) : destroyed(destroyed) {
+    }
+
+    ~Counted() {
+        destroyed->fetch_add(1);
+    }
+
+    std::atomic<int>* destroyed;
+};
+
+constexpr int kThreads = 4;
+constexpr int kIterations = 20'000;
+
+}  // namespace
+
+TEST_CASE("Concurrent copies") {
+    std::atomic<int> destroyed = 0;
+    {
+        auto shared = MakeShared<Counted>(&destroyed);
+        // Catch assertions are not thread-safe: threads count failures instead.
+        std::atomic<int> expired = 0;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < kThreads; ++i) {
+            threads.emplace_back([shared, &expired] {
+                for (int j = 0; j < kIterations; ++j) {
+                    SharedPtr<Counted> copy = shared;
+                    WeakPtr<Counted> weak = copy;
+                    if (weak.Expired()) {
+                        expired.fetch_add(1);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(expired == 0);
+        REQUIRE(shared.UseCount() == 1);
+        REQUIRE(destroyed == 0);
+    }
+    REQUIRE(destroyed == 1);
+}
+
+TEST_CASE("Lock races with the last release") {
+    std::atomic<int> destroyed = 0;
+    std::atomic<int> broken = 0;
+    for (int i = 0; i < 2'000; ++i) {
+        auto shared = MakeShared<Counted>(&destroyed);
+        WeakPtr<Counted> weak = shared;
+
+        std::thread locker([&weak, &broken] {
+            while (true) {
+                auto locked = weak.Lock();
+                if (!locked) {
+                    break;
+                }
+                if (locked->destroyed == nullptr) {
+                    broken.fetch_add(1);
+                }
+            }
+        });
+        shared.Reset();
+        locker.join();
+
+        REQUIRE(broken == 0);
+        REQUIRE(weak.Expired());
+        REQUIRE(destroyed == i + 1);
+    }
+}
+
+TEST_CASE("Biased counting on the owner thread") {
+    std::atomic<int> destroyed = 0;
+    {
+        auto shared = MakeShared<Counted>(BiasedCountingTag{}, &destroyed);
+        std::vector<SharedPtr<Counted>> copies(10, shared);
+        REQUIRE(shared.UseCount() == 11);
+
+        WeakPtr<Counted> weak = shared;
+        copies.clear();
+        REQUIRE(weak.Lock().UseCount() == 2);
+        REQUIRE(shared.UseCount() == 1);
+    }
+    REQUIRE(destroyed == 1);
+
+    SharedPtr<Counted> raw(new Counted(&destroyed), BiasedCountingTag{});
+    raw.Reset();
+    REQUIRE(destroyed == 2);
+}
+
+TEST_CASE("Counting tags with a derived pointer") {
+    struct Base {
+        virtual ~Base() = default;
+    };
+    struct Derived : Base {
+        explicit Derived(std::atomic<int>* destroyed) : counted(destroyed) {
+        }
+
+        Counted counted;
+    };
+
+    std::atomic<int> destroyed = 0;
+    SharedPtr<Base> biased(new Derived(&destroyed), BiasedCountingTag{});
+    biased.Reset();
+    REQUIRE(destroyed == 1);
+
+    SharedPtr<Base> hazard(new Derived(&destroyed), HazardReclamationTag{});
+    hazard.Reset();
+    HazardDomain::Default().Reclaim();
+    REQUIRE(destroyed == 2);
+}
+
+TEST_CASE("Biased counting across threads") {
+    std::atomic<int> destroyed = 0;
+    auto shared = MakeShared<Counted>(BiasedCountingTag{}, &destroyed);
+    WeakPtr<Counted> weak = shared;
+
+    // Catch assertions are not thread-safe: threads count failures instead.
+    std::atomic<int> undercounted = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back([shared, &undercounted] {
+            for (int j = 0; j < kIterations; ++j) {
+                SharedPtr<Counted> copy = shared;
+                if (copy.UseCount() < 2) {
+                    undercounted.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (int i = 0; i < kIterations; ++i) {
+        SharedPtr<Counted> copy = shared;
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(undercounted == 0);
+    REQUIRE(shared.UseCount() == 1);
+
+    // The last reference goes away on the owner thread.
+    shared.Reset();
+    REQUIRE(weak.Expired());
+    REQUIRE(destroyed == 1);
+}
+
+TEST_CASE("Biased references released by another thread") {
+    std::atomic<int> destroyed = 0;
+
+    SECTION("Merged when the owner flushes") {
+        auto shared = MakeShared<Counted>(BiasedCountingTag{}, &destroyed);
+        std::thread([moved = std::move(shared)]() mutable { moved.Reset(); }).join();
+        REQUIRE(destroyed == 0);
+        FlushBiasedRefCounts();
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Merged when the owner exits") {
+        SharedPtr<Counted> handed_out;
+        std::thread([&handed_out, &destroyed] {
+            handed_out = MakeShared<Counted>(BiasedCountingTag{}, &destroyed);
+        }).join();
+        REQUIRE(handed_out.UseCount() == 1);
+        handed_out.Reset();
+        REQUIRE(destroyed == 1);
+    }
+}
+
+TEST_CASE("Hazard pointers keep retired objects alive") {
+    struct Versioned {
+        Versioned(int version, std::atomic<int>* destroyed) : version(version), counted(destroyed) {
+        }
+
+        int version;
+        Counted counted;
+    };
+
+    std::atomic<int> destroyed = 0;
+    {
+        SharedPtr<Versioned> current = MakeShared<Versioned>(HazardReclamationTag{}, 0, &destroyed);
+        std::atomic<Versioned*> source = current.Get();
+        std::atomic<bool> stop = false;
+        std::atomic<int> stale = 0;
+
+        std::vector<std::thread> readers;
+        for (int i = 0; i < kThreads; ++i) {
+            readers.emplace_back([&] {
+                HazardPointer hazard;
+                int last = 0;
+                while (!stop.load()) {
+                    Versioned* read = hazard.Protect(source);
+                    if (read->version < last) {
+                        stale.fetch_add(1);
+                    }
+                    last = read->version;
+                }
+            });
+        }
+        for (int version = 1; version <= kIterations; ++version) {
+            SharedPtr<Versioned> next =
+                MakeShared<Versioned>(HazardReclamationTag{}, version, &destroyed);
+            source.store(next.Get());
+            current = std::move(next);
+        }
+        stop.store(true);
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        REQUIRE(stale == 0);
+    }
+    HazardDomain::Default().Reclaim();
+    REQUIRE(destroyed == kIterations + 1);
+}
+
+TEST_CASE("Sharded counting") {
+    std::atomic<int> destroyed = 0;
+
+    SECTION("Single thread") {
+        auto shared = MakeShared<Counted>(ShardedCountingTag{}, &destroyed);
+        std::vector<SharedPtr<Counted>> copies(10, shared);
+        REQUIRE(shared.UseCount() == 11);
+
+        WeakPtr<Counted> weak = shared;
+        copies.clear();
+        REQUIRE(weak.Lock().UseCount() == 2);
+        shared.Reset();
+        REQUIRE(weak.Expired());
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("Copies on every thread") {
+        auto shared = MakeShared<Counted>(ShardedCountingTag{}, &destroyed);
+        WeakPtr<Counted> weak = shared;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < kThreads; ++i) {
+            threads.emplace_back([shared] {
+                for (int j = 0; j < kIterations; ++j) {
+                    SharedPtr<Counted> copy = shared;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(shared.UseCount() == 1);
+        shared.Reset();
+        REQUIRE(weak.Expired());
+        REQUIRE(destroyed == 1);
+    }
+
+    SECTION("References handed between threads") {
+        for (int i = 0; i < 200; ++i) {
+            auto shared = MakeShared<Counted>(ShardedCountingTag{}, &destroyed);
+            WeakPtr<Counted> weak = shared;
+            std::vector<SharedPtr<Counted>> copies(kThreads, shared);
+            std::thread locker([weak] {
+                while (weak.Lock()) {
+                }
+            });
+            std::vector<std::thread> threads;
+            for (auto& copy : copies) {
+                threads.emplace_back([moved = std::move(copy)]() mutable { moved.Reset(); });
+            }
+            shared.Reset();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            locker.join();
+            REQUIRE(destroyed == i + 1);
+        }
+    }
+}
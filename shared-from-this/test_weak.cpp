@@ -5,6 +5,10 @@
 
 #include <catch.hpp>
 
+#include <map>
+#include <string>
+#include <vector>
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 TEST_CASE("Empty weak") {
@@ -163,3 +167,114 @@ TEST_CASE("Lifetimes") {
         delete wp;
     }
 }
+
+TEST_CASE("TryLock") {
+    WeakPtr<int> empty;
+    SharedPtr<int> out = MakeShared<int>(1);
+    REQUIRE(!empty.TryLock(out));
+    REQUIRE(*out == 1);
+
+    auto shared = MakeShared<int>(2);
+    WeakPtr<int> weak = shared;
+    REQUIRE(weak.TryLock(out));
+    REQUIRE(*out == 2);
+    REQUIRE(shared.UseCount() == 2);
+
+    out.Reset();
+    shared.Reset();
+    REQUIRE(!weak.TryLock(out));
+    REQUIRE(out.Get() == nullptr);
+
+    // `out` is the last owner of the object holding `weak`.
+    struct Holder {
+        WeakPtr<int> weak;
+        int x = 0;
+    };
+    auto target = MakeShared<int>(3);
+    Holder* holder = nullptr;
+    {
+        auto owner = MakeShared<Holder>();
+        owner->weak = target;
+        holder = owner.Get();
+        out = SharedPtr<int>(owner, &owner->x);
+    }
+    REQUIRE(holder->weak.TryLock(out));
+    REQUIRE(*out == 3);
+    REQUIRE(target.UseCount() == 2);
+}
+
+TEST_CASE("Expiry hooks") {
+    SECTION("Before and after destruction") {
+        std::vector<std::string> events;
+        struct Loud {
+            ~Loud() {
+                events->push_back("destroyed");
+            }
+            std::vector<std::string>* events;
+        };
+
+        auto shared = MakeShared<Loud>(&events);
+        WeakPtr<Loud> weak = shared;
+        OnExpiry(shared, [&] { events.push_back("after"); });
+        OnExpiry(
+            shared, [&] { events.push_back("before " + std::to_string(weak.Expired())); },
+            ExpiryHook::kBeforeDestroy);
+        auto copy = shared;
+        shared.Reset();
+        REQUIRE(events.empty());
+        copy.Reset();
+        REQUIRE(events == std::vector<std::string>{"before 1", "destroyed", "after"});
+    }
+
+    SECTION("Index of weak pointers") {
+        std::map<int, WeakPtr<int>> index;
+        std::vector<SharedPtr<int>> owners;
+        for (int i = 0; i < 10; ++i) {
+            owners.push_back(MakeShared<int>(i));
+            index[i] = owners.back();
+            // Drops the last `WeakPtr` to the object from inside the callback.
+            REQUIRE(OnExpiry(index[i], [&index, i] { index.erase(i); }));
+        }
+        owners.erase(owners.begin() + 3);
+        REQUIRE(index.size() == 9);
+        REQUIRE(!index.contains(3));
+        owners.clear();
+        REQUIRE(index.empty());
+    }
+
+    SECTION("Expired or empty pointers") {
+        WeakPtr<int> weak;
+        REQUIRE(!OnExpiry(weak, [] {}));
+        {
+            SharedPtr<int> shared(new int(1));
+            weak = shared;
+        }
+        bool fired = false;
+        REQUIRE(!OnExpiry(weak, [&fired] { fired = true; }));
+        REQUIRE(!fired);
+        REQUIRE_THROWS_AS(OnExpiry(SharedPtr<int>(), [] {}), std::invalid_argument);
+    }
+
+    SECTION("Blocks reused after expiry start without hooks") {
+        int fired = 0;
+        {
+            auto shared = MakeShared<int>(1);
+            OnExpiry(shared, [&fired] { ++fired; });
+        }
+        for (int i = 0; i < 100; ++i) {
+            MakeShared<int>(i);
+        }
+        REQUIRE(fired == 1);
+    }
+
+    SECTION("Reset to a new object") {
+        int fired = 0;
+        SharedPtr<int> shared(new int(1));
+        OnExpiry(shared, [&fired] { ++fired; });
+        shared.Reset(new int(2));
+        REQUIRE(fired == 1);
+        REQUIRE(*shared == 2);
+        shared.Reset();
+        REQUIRE(fired == 1);
+    }
+}
@@ -0,0 +1,157 @@
+#include "compact_shared.h"
+#include "weak_key_map.h"
+
+#include <catch.hpp>
+
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Pair {
+    int first = 1;
+    int second = 2;
+};
+
+}  // namespace
+
+TEST_CASE("Owner-based comparisons") {
+    auto pair = MakeShared<Pair>();
+    SharedPtr<int> first(pair, &pair->first);
+    SharedPtr<int> second(pair, &pair->second);
+    WeakPtr<int> weak = second;
+    auto other = MakeShared<Pair>();
+
+    REQUIRE(OwnerEqual()(first, second));
+    REQUIRE(OwnerEqual()(weak, pair));
+    REQUIRE(!OwnerEqual()(pair, other));
+    REQUIRE(OwnerHash()(first) == OwnerHash()(weak));
+    REQUIRE(OwnerBefore()(pair, other) != OwnerBefore()(other, pair));
+    REQUIRE(!OwnerBefore()(first, weak));
+    REQUIRE(!OwnerBefore()(weak, first));
+
+    auto compact = MakeCompactShared<int>(3);
+    SharedPtr<int> shared = compact;
+    REQUIRE(OwnerEqual()(compact, shared));
+    REQUIRE(OwnerHash()(compact) == OwnerHash()(shared));
+
+    SECTION("Expired pointers keep their identity") {
+        pair.Reset();
+        first.Reset();
+        second.Reset();
+        REQUIRE(weak.Expired());
+        std::set<WeakPtr<int>, OwnerBefore> ordered{weak};
+        REQUIRE(ordered.size() == 1);
+        REQUIRE(ordered.count(weak) == 1);
+    }
+
+    SECTION("Standard containers") {
+        std::unordered_set<WeakPtr<int>, OwnerHash, OwnerEqual> weaks;
+        weaks.insert(weak);
+        weaks.insert(first);
+        weaks.insert(SharedPtr<int>(other, &other->second));
+        REQUIRE(weaks.size() == 2);
+        REQUIRE(weaks.contains(pair));
+        std::map<SharedPtr<Pair>, int, OwnerBefore> by_owner{{pair, 1}, {other, 2}};
+        REQUIRE(by_owner.find(weak)->second == 1);
+    }
+}
+
+TEST_CASE("WeakKeyHashMap basics") {
+    WeakKeyHashMap<std::string, int> map;
+    REQUIRE(map.Empty());
+    auto key = MakeShared<std::string>("key");
+    REQUIRE(map.Find(key) == nullptr);
+
+    auto [value, inserted] = map.Insert(key, 1);
+    REQUIRE(inserted);
+    REQUIRE(*value == 1);
+    REQUIRE(key.UseCount() == 1);
+
+    auto [again, inserted_again] = map.Insert(key, 2);
+    REQUIRE(!inserted_again);
+    REQUIRE(again == value);
+    REQUIRE(*map.Find(key) == 1);
+
+    WeakPtr<std::string> weak = key;
+    ++map[weak];
+    REQUIRE(*map.Find(weak) == 2);
+    REQUIRE(map.Size() == 1);
+
+    REQUIRE(map.Erase(key));
+    REQUIRE(!map.Erase(key));
+    REQUIRE(map.Find(key) == nullptr);
+    REQUIRE(map.Empty());
+
+    REQUIRE_THROWS_AS(map.Insert(WeakPtr<std::string>(), 0), std::invalid_argument);
+}
+
+TEST_CASE("WeakKeyHashMap never locks a key") {
+    WeakKeyHashMap<int, std::string> map;
+    WeakPtr<int> weak;
+    {
+        auto key = MakeShared<int>(1);
+        weak = key;
+        map.Insert(key, "dead");
+    }
+    // Still found by owner, no object needed.
+    REQUIRE(weak.Expired());
+    REQUIRE(*map.Find(weak) == "dead");
+    REQUIRE(map.Purge() == 1);
+    REQUIRE(map.Find(weak) == nullptr);
+    REQUIRE(map.Purge() == 0);
+}
+
+TEST_CASE("WeakKeyHashMap purges expired keys as it grows") {
+    WeakKeyHashMap<int, int> map;
+    std::vector<SharedPtr<int>> alive;
+    for (int round = 0; round < 100; ++round) {
+        for (int i = 0; i < 100; ++i) {
+            auto key = MakeShared<int>(i);
+            map.Insert(key, i);
+            if (i % 10 == 0) {
+                alive.push_back(key);
+            }
+        }
+    }
+    // Without purging this would have grown to hold 10000 entries.
+    REQUIRE(map.Capacity() < 8192);
+    for (const auto& key : alive) {
+        REQUIRE(*map.Find(key) == *key);
+    }
+    map.Purge();
+    REQUIRE(map.Size() == alive.size());
+
+    size_t visited = 0;
+    map.ForEach([&visited](const WeakPtr<int>& key, int& value) {
+        REQUIRE(*key.Lock() == value);
+        ++visited;
+    });
+    REQUIRE(visited == alive.size());
+}
+
+TEST_CASE("WeakKeyHashMap erase keeps probe chains") {
+    WeakKeyHashMap<int, int> map;
+    std::vector<SharedPtr<int>> keys;
+    for (int i = 0; i < 1000; ++i) {
+        keys.push_back(MakeShared<int>(i));
+        map.Insert(keys.back(), i);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        REQUIRE(map.Erase(keys[i]));
+    }
+    REQUIRE(map.Size() == 500);
+    for (int i = 0; i < 1000; ++i) {
+        int* value = map.Find(keys[i]);
+        if (i % 2 == 0) {
+            REQUIRE(value == nullptr);
+        } else {
+            REQUIRE(*value == i);
+        }
+    }
+}
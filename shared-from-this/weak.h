@@ -19,7 +19,7 @@ public:
         block = other.block;
         real_object = other.real_object;
         if (block != nullptr) {
-            ++block->weak_counter;
+            block->IncWeak();
         }
     };
 
@@ -28,7 +28,7 @@ public:
         block = other.block;
         real_object = other.real_object;
         if (block != nullptr) {
-            ++block->weak_counter;
+            block->IncWeak();
         }
     };
 
@@ -53,7 +53,7 @@ public:
         block = other.block;
         real_object = other.real_object;
         if (block != nullptr) {
-            ++block->weak_counter;
+            block->IncWeak();
         }
     };
 
@@ -65,7 +65,7 @@ public:
         block = other.block;
         real_object = other.real_object;
         if (block != nullptr) {
-            ++block->weak_counter;
+            block->IncWeak();
         }
         return *this;
     };
@@ -76,7 +76,7 @@ public:
         block = other.block;
         real_object = other.real_object;
         if (block != nullptr) {
-            ++block->weak_counter;
+            block->IncWeak();
         }
         return *this;
     };
@@ -104,47 +104,17 @@ public:
     // Destructor
 
     ~WeakPtr() {
-        if (block == nullptr) {
-            return;
-        }
-        if (block->weak_counter > 1) {
-            --block->weak_counter;
-            block = nullptr;
-            real_object = nullptr;
-        } else {
-            if (block->strong_counter == 0) {
-                delete block;
-                block = nullptr;
-                real_object = nullptr;
-            } else {
-                --block->weak_counter;
-                block = nullptr;
-                real_object = nullptr;
-            }
-        }
+        Reset();
     };
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Modifiers
 
     void Reset() {
-        if (block == nullptr) {
-            return;
-        }
-        if (block->weak_counter > 1) {
-            --block->weak_counter;
-            block = nullptr;
-            real_object = nullptr;
-        } else {
-            if (block->strong_counter == 0) {
-                delete block;
-                block = nullptr;
-                real_object = nullptr;
-            } else {
-                --block->weak_counter;
-                block = nullptr;
-                real_object = nullptr;
-            }
+        BaseBlock* released = std::exchange(block, nullptr);
+        real_object = nullptr;
+        if (released != nullptr) {
+            released->ReleaseWeak();
         }
     };
     void Swap(WeakPtr& other) {
@@ -159,37 +129,90 @@ public:
         if (block == nullptr) {
             return 0;
         }
-        return block->strong_counter;
+        return block->StrongCount();
     };
 
     bool Expired() const {
         if (block == nullptr) {
             return true;
         }
-        if (block->strong_counter == 0) {
-            return true;
-        }
-        return false;
+        return block->StrongCount() == 0;
     };
 
-    SharedPtr<T> Lock() const {
+    // The strong count is only bumped if it is still nonzero, so a concurrent release of the last
+    // `SharedPtr` either happens before (and we return an empty pointer) or after (and we keep the
+    // object alive).
+    SharedPtr<T> Lock() const noexcept {
         SharedPtr<T> ans;
-        if (block == nullptr) {
-            ans.block = nullptr;
-            ans.real_object = nullptr;
-        } else if (block->strong_counter == 0) {
-            ans.block = nullptr;
-            ans.real_object = nullptr;
-        } else {
-            ans.block = block;
-            ans.real_object = real_object;
-            //--block->weak_counter;
-            ++block->strong_counter;
-        }
+        TryLock(ans);
         return ans;
     };
 
+    // Same as `Lock`, but reports whether it succeeded: returns false and leaves `out` untouched
+    // if there is no object to share (the pointer is empty or expired).
+    bool TryLock(SharedPtr<T>& out) const noexcept {
+        if (block == nullptr || !block->TryIncStrong()) {
+            return false;
+        }
+        // `out` may be the last owner of the object holding `*this`: read everything first.
+        BaseBlock* locked = block;
+        T* object = real_object;
+        out.Reset();
+        out.block = locked;
+        out.real_object = object;
+        return true;
+    };
+
     BaseBlock* block;
     T* real_object;
 };
 
+// Same as `OnExpiry(const SharedPtr&, ...)`. Returns false (and registers nothing) if the object is
+// already gone.
+template <typename T>
+bool OnExpiry(const WeakPtr<T>& ptr, std::function<void()> callback,
+              ExpiryHook when = ExpiryHook::kAfterDestroy) {
+    SharedPtr<T> locked;
+    if (!ptr.TryLock(locked)) {
+        return false;
+    }
+    OnExpiry(locked, std::move(callback), when);
+    return true;
+};
+
+// Owner-based hashing, equality and ordering, like `std::owner_less`: pointers are equivalent when
+// they share ownership of the same object (the same control block), whatever they point at and
+// whether or not the object is still alive. They work on `SharedPtr`, `WeakPtr` and
+// `CompactSharedPtr` alike, and never lock a `WeakPtr`.
+struct OwnerHash {
+    using is_transparent = void;
+
+    template <typename Ptr>
+    size_t operator()(const Ptr& ptr) const noexcept {
+        // Blocks are at least 8-byte aligned: spread the address over all bits, so that tables
+        // indexed by the low ones do not cluster.
+        uint64_t key = reinterpret_cast<uintptr_t>(static_cast<const BaseBlock*>(ptr.block));
+        key *= 0x9e3779b97f4a7c15;
+        return static_cast<size_t>(key ^ (key >> 32));
+    };
+};
+
+struct OwnerEqual {
+    using is_transparent = void;
+
+    template <typename Left, typename Right>
+    bool operator()(const Left& left, const Right& right) const noexcept {
+        const BaseBlock* left_block = left.block;
+        const BaseBlock* right_block = right.block;
+        return left_block == right_block;
+    };
+};
+
+struct OwnerBefore {
+    using is_transparent = void;
+
+    template <typename Left, typename Right>
+    bool operator()(const Left& left, const Right& right) const noexcept {
+        return std::less<const BaseBlock*>()(left.block, right.block);
+    };
+};
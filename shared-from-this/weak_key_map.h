@@ -0,0 +1,200 @@
+#pragma once
+
+#include "shared.h"
+#include "weak.h"
+
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Hash map keyed by the owner of a `WeakPtr<K>` (see `OwnerHash`), for side tables about objects
+// the map must not keep alive.
+//
+// Open addressing with linear probing over a power-of-two table. Lookups compare control block
+// addresses only: they never lock a key or even look at its counts. A key whose object died stays
+// until the table next needs to grow, when all expired keys are purged in the same pass that
+// rehashes (`Purge()` does it on demand). Its block is kept alive by the key meanwhile, so no other
+// object can get the same address and match it.
+//
+// Not thread-safe.
+template <typename K, typename V>
+class WeakKeyHashMap {
+public:
+    WeakKeyHashMap() = default;
+
+    WeakKeyHashMap(const WeakKeyHashMap&) = delete;
+    WeakKeyHashMap& operator=(const WeakKeyHashMap&) = delete;
+
+    WeakKeyHashMap(WeakKeyHashMap&&) = default;
+    WeakKeyHashMap& operator=(WeakKeyHashMap&&) = default;
+
+    // `key` may be a `SharedPtr`, `WeakPtr` or `CompactSharedPtr` to any type sharing the owner.
+    template <typename Ptr>
+    V* Find(const Ptr& key) {
+        if (size_ == 0) {
+            return nullptr;
+        }
+        for (size_t index = IndexOf(key);; index = (index + 1) & Mask()) {
+            std::optional<Entry>& slot = slots_[index];
+            if (!slot) {
+                return nullptr;
+            }
+            if (OwnerEqual()(slot->key, key)) {
+                return &slot->value;
+            }
+        }
+    }
+
+    template <typename Ptr>
+    bool Contains(const Ptr& key) {
+        return Find(key) != nullptr;
+    }
+
+    // Adds `key` with `value` unless its owner is already there. Returns the value kept for the
+    // owner and whether it was inserted. Throws `std::invalid_argument` for an empty key.
+    std::pair<V*, bool> Insert(WeakPtr<K> key, V value) {
+        if (key.block == nullptr) {
+            throw std::invalid_argument("WeakKeyHashMap needs a non-empty key");
+        }
+        if (V* found = Find(key)) {
+            return {found, false};
+        }
+        if ((size_ + 1) * kMaxLoadDenominator > slots_.size() * kMaxLoadNumerator) {
+            Rehash(1);
+        }
+        size_t index = IndexOf(key);
+        while (slots_[index]) {
+            index = (index + 1) & Mask();
+        }
+        slots_[index].emplace(Entry{std::move(key), std::move(value)});
+        ++size_;
+        return {&slots_[index]->value, true};
+    }
+
+    // Returns the value for `key`, inserting a default one first if needed.
+    V& operator[](const WeakPtr<K>& key) {
+        return *Insert(key, V()).first;
+    }
+
+    template <typename Ptr>
+    bool Erase(const Ptr& key) {
+        if (size_ == 0) {
+            return false;
+        }
+        size_t index = IndexOf(key);
+        for (;; index = (index + 1) & Mask()) {
+            if (!slots_[index]) {
+                return false;
+            }
+            if (OwnerEqual()(slots_[index]->key, key)) {
+                break;
+            }
+        }
+        EraseAt(index);
+        return true;
+    }
+
+    // Drops every key whose object is gone. Returns how many there were.
+    size_t Purge() {
+        if (size_ == 0) {
+            return 0;
+        }
+        size_t before = size_;
+        Rehash(0);
+        return before - size_;
+    }
+
+    // Calls `visit(key, value)` for every entry, expired ones included.
+    template <typename Visit>
+    void ForEach(Visit visit) {
+        for (std::optional<Entry>& slot : slots_) {
+            if (slot) {
+                visit(std::as_const(slot->key), slot->value);
+            }
+        }
+    }
+
+    // Entries, counting expired keys not purged yet.
+    size_t Size() const {
+        return size_;
+    }
+
+    bool Empty() const {
+        return size_ == 0;
+    }
+
+    size_t Capacity() const {
+        return slots_.size();
+    }
+
+private:
+    struct Entry {
+        WeakPtr<K> key;
+        V value;
+    };
+
+    static constexpr size_t kMinCapacity = 16;
+    // Grow past 3/4 full: longer probe chains cost more than the memory.
+    static constexpr size_t kMaxLoadNumerator = 3;
+    static constexpr size_t kMaxLoadDenominator = 4;
+
+    size_t Mask() const {
+        return slots_.size() - 1;
+    }
+
+    template <typename Ptr>
+    size_t IndexOf(const Ptr& key) const {
+        return OwnerHash()(key) & Mask();
+    }
+
+    // Removes the entry at `index` and moves later entries of the same probe chains back, so that
+    // no chain has a hole (no tombstones needed).
+    void EraseAt(size_t index) {
+        slots_[index].reset();
+        --size_;
+        for (size_t next = (index + 1) & Mask(); slots_[next]; next = (next + 1) & Mask()) {
+            size_t home = IndexOf(slots_[next]->key);
+            // Move `next` into the hole unless its home lies cyclically in (index, next].
+            bool stays = index <= next ? (index < home && home <= next)
+                                       : (index < home || home <= next);
+            if (!stays) {
+                slots_[index] = std::move(slots_[next]);
+                slots_[next].reset();
+                index = next;
+            }
+        }
+    }
+
+    // Rebuilds the table without expired keys, with room for `extra` more entries. The new table is
+    // at most half full, so the next rebuild is a quarter of its capacity of inserts away.
+    void Rehash(size_t extra) {
+        std::vector<std::optional<Entry>> old = std::move(slots_);
+        std::vector<Entry> live;
+        live.reserve(size_);
+        for (std::optional<Entry>& slot : old) {
+            if (slot && !slot->key.Expired()) {
+                live.push_back(std::move(*slot));
+            }
+        }
+        old.clear();
+
+        size_t capacity = kMinCapacity;
+        while ((live.size() + extra) * 2 > capacity) {
+            capacity *= 2;
+        }
+        slots_.assign(capacity, std::nullopt);
+        size_ = live.size();
+        for (Entry& entry : live) {
+            size_t index = IndexOf(entry.key);
+            while (slots_[index]) {
+                index = (index + 1) & Mask();
+            }
+            slots_[index].emplace(std::move(entry));
+        }
+    }
+
+    std::vector<std::optional<Entry>> slots_;
+    size_t size_ = 0;
+};
@@ -4,27 +4,114 @@
 
 #include <cstddef>  // std::nullptr_t
 #include <array>
+#include <atomic>
 
 // https://en.cppreference.com/w/cpp/memory/shared_ptr
 
+// Reference counting policies for control blocks.
+//
+// `SingleThreadedPolicy` keeps plain counters: it is the cheapest one, but every copy of a pointer
+// has to stay on the thread that owns it. `AtomicPolicy` lets pointers to the same block be copied
+// and released from different threads without any external locking.
+//
+// Define SMART_PTRS_SINGLE_THREADED before including this header to get the single-threaded one.
+struct SingleThreadedPolicy {
+    using Counter = size_t;
+
+    static void Increment(Counter& counter) {
+        ++counter;
+    }
+
+    // Returns the value after the decrement.
+    static size_t Decrement(Counter& counter) {
+        return --counter;
+    }
+
+    static bool IncrementIfNonZero(Counter& counter) {
+        if (counter == 0) {
+            return false;
+        }
+        ++counter;
+        return true;
+    }
+
+    static size_t Load(const Counter& counter) {
+        return counter;
+    }
+};
+
+struct AtomicPolicy {
+    using Counter = std::atomic<size_t>;
+
+    static void Increment(Counter& counter) {
+        // A new reference is always made from an existing one, so there is nothing to order here.
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns the value after the decrement.
+    static size_t Decrement(Counter& counter) {
+        size_t left = counter.fetch_sub(1, std::memory_order_release) - 1;
+        if (left == 0) {
+            // Only the last owner pays for the fence: it makes every write done through the other
+            // (already released) owners visible before the object is destroyed.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return left;
+    }
+
+    static bool IncrementIfNonZero(Counter& counter) {
+        size_t current = counter.load(std::memory_order_relaxed);
+        while (current != 0) {
+            if (counter.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static size_t Load(const Counter& counter) {
+        return counter.load(std::memory_order_acquire);
+    }
+};
+
+#ifdef SMART_PTRS_SINGLE_THREADED
+using RefCountPolicy = SingleThreadedPolicy;
+#else
+using RefCountPolicy = AtomicPolicy;
+#endif
+
 class BaseBlock {
 public:
     BaseBlock(){};
     virtual ~BaseBlock(){};
-    size_t counter = 0;
+
+    void IncStrong() {
+        RefCountPolicy::Increment(counter);
+    }
+
+    size_t StrongCount() const {
+        return RefCountPolicy::Load(counter);
+    }
+
+    void ReleaseStrong() {
+        if (RefCountPolicy::Decrement(counter) == 0) {
+            delete this;
+        }
+    }
+
+    RefCountPolicy::Counter counter{1};
 };
 
 template <typename T>
 class HolderBlock : public BaseBlock {
 public:
     HolderBlock() {
-        ++counter;
         new (&storage) T();
     }
 
     template <typename... Args>
     HolderBlock(Args&&... args) {
-        ++counter;
         new (&storage) T(std::forward<Args>(args)...);
         // new (storage) T(std::forward<Args>(args)...);
     };
@@ -46,7 +133,6 @@ template <typename T>
 class PointerBlock : public BaseBlock {
 public:
     PointerBlock(T* obj_pointer) {
-        ++counter;
         object_pointer = obj_pointer;
     }
     ~PointerBlock() override {
@@ -77,21 +163,19 @@ public:
     explicit SharedPtr(T* ptr) {
         block = new PointerBlock(ptr);  //
         real_object = ptr;
-        block->counter = 1;
     };
 
     template <class U>
     explicit SharedPtr(U* ptr) {
         block = new PointerBlock(ptr);  //
         real_object = ptr;
-        block->counter = 1;
     };
 
     SharedPtr(const SharedPtr& other) {
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -103,7 +187,7 @@ public:
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -112,16 +196,12 @@ public:
 
     SharedPtr& operator=(const SharedPtr& other) {
         if (block != nullptr) {
-            if (block->counter > 1) {
-                --block->counter;
-            } else {
-                delete block;
-            }
+            block->ReleaseStrong();
         }
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -132,16 +212,12 @@ public:
     template <class U>
     SharedPtr& operator=(const SharedPtr<U>& other) {
         if (block != nullptr) {
-            if (block->counter > 1) {
-                --block->counter;
-            } else {
-                delete block;
-            }
+            block->ReleaseStrong();
         }
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -166,11 +242,7 @@ public:
 
     SharedPtr& operator=(SharedPtr&& other) {
         if (block != nullptr) {
-            if (block->counter > 1) {
-                --block->counter;
-            } else {
-                delete block;
-            }
+            block->ReleaseStrong();
         }
         block = other.block;
         real_object = other.real_object;
@@ -182,11 +254,7 @@ public:
     template <class U>
     SharedPtr& operator=(SharedPtr<U>&& other) {
         if (block != nullptr) {
-            if (block->counter > 1) {
-                --block->counter;
-            } else {
-                delete block;
-            }
+            block->ReleaseStrong();
         }
         block = other.block;
         real_object = other.real_object;
@@ -201,7 +269,7 @@ public:
     SharedPtr(const SharedPtr<Y>& other, T* ptr) {
         block = other.block;
         real_object = ptr;
-        ++block->counter;
+        block->IncStrong();
     };
 
     // Promote `WeakPtr`
@@ -218,15 +286,9 @@ public:
         if (block == nullptr) {
             return;
         }
-        if (block->counter > 1) {
-            --block->counter;
-            block = nullptr;
-            real_object = nullptr;
-        } else {
-            delete block;
-            block = nullptr;
-            real_object = nullptr;
-        }
+        block->ReleaseStrong();
+        block = nullptr;
+        real_object = nullptr;
     };
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -236,39 +298,25 @@ public:
         if (block == nullptr) {
             return;
         }
-        if (block->counter > 1) {
-            --block->counter;
-            block = nullptr;
-            real_object = nullptr;
-        } else {
-            delete block;
-            block = nullptr;
-            real_object = nullptr;
-        }
+        block->ReleaseStrong();
+        block = nullptr;
+        real_object = nullptr;
     };
     void Reset(T* ptr) {
-        if (block == nullptr) {
-        } else if (block->counter > 1) {
-            --block->counter;
-        } else {
-            delete block;
+        if (block != nullptr) {
+            block->ReleaseStrong();
         }
         block = new PointerBlock(ptr);
         real_object = ptr;
-        block->counter = 1;
     };
 
     template <typename U>
     void Reset(U* ptr) {
-        if (block == nullptr) {
-        } else if (block->counter > 1) {
-            --block->counter;
-        } else {
-            delete block;
+        if (block != nullptr) {
+            block->ReleaseStrong();
         }
         block = new PointerBlock(ptr);
         real_object = ptr;
-        block->counter = 1;
     };
 
     void Swap(SharedPtr& other) {
@@ -292,7 +340,7 @@ public:
 
     size_t UseCount() const {
         if (block != nullptr) {
-            return block->counter;
+            return block->StrongCount();
         }
         return 0;
     };
@@ -308,7 +356,9 @@ public:
 };
 
 template <typename T, typename U>
-inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right);
+inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right) {
+    return left.block == right.block;
+};
 
 // Allocate memory only once
 template <typename T, typename... Args>
@@ -316,7 +366,6 @@ SharedPtr<T> MakeShared(Args&&... args) {
     HolderBlock<T>* block = new HolderBlock<T>(std::forward<Args>(args)...);
     SharedPtr<T> ans;
     ans.block = block;
-    block->counter = 1;
     ans.real_object = block->GetPointer();
     return ans;
 };
@@ -9,4 +9,3 @@ class SharedPtr;
 
 template <typename T>
 class WeakPtr;
-s
\ No newline at end of file
@@ -78,7 +78,7 @@ public:
 
     template <class U, class V>
     CompressedPair(U&& first, V&& second)
-        : first_(std::forward<U>(first)), S(std::forward<V>(second)) {
+        : S(std::forward<V>(second)), first_(std::forward<U>(first)) {
     }
 
     F& GetFirst() {
@@ -504,3 +504,33 @@ TEST_CASE("Upcasts") {
         s2 = std::move(s);
     }
 }
+
+TEST_CASE("MakeUniqueIn") {
+    Arena arena;
+    REQUIRE(MyInt::AliveCount() == 0);
+    {
+        auto first = MakeUniqueIn<MyInt>(arena, 3);
+        UniquePtr<MyInt, ArenaDelete> second;
+        REQUIRE(MyInt::AliveCount() == 1);
+        second = std::move(first);
+        REQUIRE(*second == 3);
+        second.Reset(MakeUniqueIn<MyInt>(arena, 4).Release());
+        REQUIRE(MyInt::AliveCount() == 1);
+    }
+    REQUIRE(MyInt::AliveCount() == 0);
+    arena.Reset();
+}
+
+TEST_CASE("MakeUniqueForOverwrite") {
+    auto buffer = MakeUniqueForOverwrite<char[]>(1 << 16);
+    buffer[(1 << 16) - 1] = 'x';
+    REQUIRE(buffer[(1 << 16) - 1] == 'x');
+
+    auto value = MakeUniqueForOverwrite<MyInt>();
+    REQUIRE(MyInt::AliveCount() == 1);
+    auto values = MakeUniqueForOverwrite<MyInt[]>(3);
+    REQUIRE(MyInt::AliveCount() == 4);
+    values.Reset();
+    value.Reset();
+    REQUIRE(MyInt::AliveCount() == 0);
+}
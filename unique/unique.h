@@ -2,6 +2,8 @@
 
 #include "compressed_pair.h"
 
+#include <common/arena.h>
+
 #include <cstddef>  // std::nullptr_t
 #include <exception>
 
@@ -397,4 +399,26 @@ public:
 
     // protected:
     CompressedPair<void*, Deleter> ptr_;
-};
\ No newline at end of file
+};
+
+// Places `T(args...)` in `arena` (see common/arena.h). The pointer runs the destructor; the memory
+// goes back only when the arena is reset.
+template <typename T, typename... Args>
+UniquePtr<T, ArenaDelete> MakeUniqueIn(Arena& arena, Args&&... args) {
+    void* memory = arena.Allocate(sizeof(T), alignof(T));
+    return UniquePtr<T, ArenaDelete>(new (memory) T(std::forward<Args>(args)...));
+}
+
+// `new T` rather than `new T()`: the object (or every element of `T[]`) is default-initialized, so
+// buffers about to be overwritten are not zeroed first.
+template <typename T>
+UniquePtr<T> MakeUniqueForOverwrite() {
+    static_assert(!std::is_array_v<T>, "MakeUniqueForOverwrite<T[]> needs a length");
+    return UniquePtr<T>(new T);
+}
+
+template <typename T>
+UniquePtr<T> MakeUniqueForOverwrite(size_t length) {
+    static_assert(std::is_unbounded_array_v<T>, "only MakeUniqueForOverwrite<T[]> takes a length");
+    return UniquePtr<T>(new std::remove_extent_t<T>[length]);
+}
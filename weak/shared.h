@@ -4,30 +4,135 @@
 
 #include <cstddef>  // std::nullptr_t
 #include <array>
+#include <atomic>
 #include <stdexcept>
 
 // https://en.cppreference.com/w/cpp/memory/shared_ptr
 
+// Reference counting policies for control blocks.
+//
+// `SingleThreadedPolicy` keeps plain counters: it is the cheapest one, but every copy of a pointer
+// has to stay on the thread that owns it. `AtomicPolicy` lets pointers to the same block be copied
+// and released from different threads without any external locking.
+//
+// Define SMART_PTRS_SINGLE_THREADED before including this header to get the single-threaded one.
+struct SingleThreadedPolicy {
+    using Counter = size_t;
+
+    static void Increment(Counter& counter) {
+        ++counter;
+    }
+
+    // Returns the value after the decrement.
+    static size_t Decrement(Counter& counter) {
+        return --counter;
+    }
+
+    static bool IncrementIfNonZero(Counter& counter) {
+        if (counter == 0) {
+            return false;
+        }
+        ++counter;
+        return true;
+    }
+
+    static size_t Load(const Counter& counter) {
+        return counter;
+    }
+};
+
+struct AtomicPolicy {
+    using Counter = std::atomic<size_t>;
+
+    static void Increment(Counter& counter) {
+        // A new reference is always made from an existing one, so there is nothing to order here.
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns the value after the decrement.
+    static size_t Decrement(Counter& counter) {
+        size_t left = counter.fetch_sub(1, std::memory_order_release) - 1;
+        if (left == 0) {
+            // Only the last owner pays for the fence: it makes every write done through the other
+            // (already released) owners visible before the object is destroyed.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return left;
+    }
+
+    static bool IncrementIfNonZero(Counter& counter) {
+        size_t current = counter.load(std::memory_order_relaxed);
+        while (current != 0) {
+            if (counter.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static size_t Load(const Counter& counter) {
+        return counter.load(std::memory_order_acquire);
+    }
+};
+
+#ifdef SMART_PTRS_SINGLE_THREADED
+using RefCountPolicy = SingleThreadedPolicy;
+#else
+using RefCountPolicy = AtomicPolicy;
+#endif
+
+// `weak_counter` holds one extra reference on behalf of all strong owners together, so the block is
+// deleted exactly once: by whoever drops the weak count to zero.
 class BaseBlock {
 public:
     BaseBlock(){};
     virtual ~BaseBlock(){};
     virtual void Clear(){};
-    size_t strong_counter = 0;
-    size_t weak_counter = 0;
+
+    void IncStrong() {
+        RefCountPolicy::Increment(strong_counter);
+    }
+
+    // Used to promote `WeakPtr`: fails if the object is already gone.
+    bool TryIncStrong() {
+        return RefCountPolicy::IncrementIfNonZero(strong_counter);
+    }
+
+    void IncWeak() {
+        RefCountPolicy::Increment(weak_counter);
+    }
+
+    size_t StrongCount() const {
+        return RefCountPolicy::Load(strong_counter);
+    }
+
+    void ReleaseStrong() {
+        if (RefCountPolicy::Decrement(strong_counter) == 0) {
+            Clear();
+            ReleaseWeak();
+        }
+    }
+
+    void ReleaseWeak() {
+        if (RefCountPolicy::Decrement(weak_counter) == 0) {
+            delete this;
+        }
+    }
+
+    RefCountPolicy::Counter strong_counter{1};
+    RefCountPolicy::Counter weak_counter{1};
 };
 
 template <typename T>
 class HolderBlock : public BaseBlock {
 public:
     HolderBlock() {
-        ++strong_counter;
         new (&storage) T();
     }
 
     template <typename... Args>
     HolderBlock(Args&&... args) {
-        ++strong_counter;
         new (&storage) T(std::forward<Args>(args)...);
         // new (storage) T(std::forward<Args>(args)...);
     };
@@ -53,7 +158,6 @@ template <typename T>
 class PointerBlock : public BaseBlock {
 public:
     PointerBlock(T* obj_pointer) {
-        ++strong_counter;
         object_pointer = obj_pointer;
     }
 
@@ -90,21 +194,19 @@ public:
     explicit SharedPtr(T* ptr) {
         block = new PointerBlock(ptr);  //
         real_object = ptr;
-        block->strong_counter = 1;
     };
 
     template <class U>
     explicit SharedPtr(U* ptr) {
         block = new PointerBlock(ptr);  //
         real_object = ptr;
-        block->strong_counter = 1;
     };
 
     SharedPtr(const SharedPtr& other) {
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->strong_counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -116,7 +218,7 @@ public:
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->strong_counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -128,7 +230,7 @@ public:
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->strong_counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -142,7 +244,7 @@ public:
         if (other.block != nullptr) {
             block = other.block;
             real_object = other.real_object;
-            ++block->strong_counter;
+            block->IncStrong();
         } else {
             block = nullptr;
             real_object = nullptr;
@@ -190,20 +292,17 @@ public:
     SharedPtr(const SharedPtr<Y>& other, T* ptr) {
         block = other.block;
         real_object = ptr;
-        ++block->strong_counter;
+        block->IncStrong();
     };
 
     // Promote `WeakPtr`
     // #11 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
     explicit SharedPtr(const WeakPtr<T>& other) {
-        if (other.block != nullptr && other.block->strong_counter == 0) {
+        if (other.block != nullptr && !other.block->TryIncStrong()) {
             throw BadWeakPtr{};
         }
         block = other.block;
         real_object = other.real_object;
-        if (block != nullptr) {
-            ++block->strong_counter;
-        }
     };
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -213,26 +312,7 @@ public:
     // Destructor
 
     ~SharedPtr() {
-        if (block == nullptr) {
-            return;
-        }
-        if (block->strong_counter > 1) {
-            --block->strong_counter;
-            block = nullptr;
-            real_object = nullptr;
-        } else {
-            if (block->weak_counter == 0) {
-                block->Clear();
-                delete block;
-                block = nullptr;
-                real_object = nullptr;
-            } else {
-                --block->strong_counter;
-                block->Clear();
-                block = nullptr;
-                real_object = nullptr;
-            }
-        }
+        Reset();
     };
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -242,28 +322,14 @@ public:
         if (block == nullptr) {
             return;
         }
-        if (block->strong_counter > 1) {
-            --block->strong_counter;
-            block = nullptr;
-            real_object = nullptr;
-        } else {
-            if (block->weak_counter == 0) {
-                delete block;
-                block = nullptr;
-                real_object = nullptr;
-            } else {
-                --block->strong_counter;
-                block->Clear();
-                block = nullptr;
-                real_object = nullptr;
-            }
-        }
+        block->ReleaseStrong();
+        block = nullptr;
+        real_object = nullptr;
     };
     void Reset(T* ptr) {
         Reset();
         block = new PointerBlock(ptr);
         real_object = ptr;
-        block->strong_counter = 1;
     };
 
     template <typename U>
@@ -271,7 +337,6 @@ public:
         Reset();
         block = new PointerBlock(ptr);
         real_object = ptr;
-        block->strong_counter = 1;
     };
 
     void Swap(SharedPtr& other) {
@@ -295,7 +360,7 @@ public:
 
     size_t UseCount() const {
         if (block != nullptr) {
-            return block->strong_counter;
+            return block->StrongCount();
         }
         return 0;
     };
@@ -319,7 +384,6 @@ SharedPtr<T> MakeShared(Args&&... args) {
     HolderBlock<T>* block = new HolderBlock<T>(std::forward<Args>(args)...);
     SharedPtr<T> ans;
     ans.block = block;
-    block->strong_counter = 1;
     ans.real_object = block->GetPointer();
     return ans;
 };
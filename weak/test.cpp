@@ -163,3 +163,21 @@ TEST_CASE("Lifetimes") {
         delete wp;
     }
 }
+
+TEST_CASE("TryLock") {
+    WeakPtr<int> empty;
+    SharedPtr<int> out = MakeShared<int>(1);
+    REQUIRE(!empty.TryLock(out));
+    REQUIRE(*out == 1);
+
+    auto shared = MakeShared<int>(2);
+    WeakPtr<int> weak = shared;
+    REQUIRE(weak.TryLock(out));
+    REQUIRE(*out == 2);
+    REQUIRE(shared.UseCount() == 2);
+
+    out.Reset();
+    shared.Reset();
+    REQUIRE(!weak.TryLock(out));
+    REQUIRE(out.Get() == nullptr);
+}
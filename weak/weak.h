@@ -19,7 +19,7 @@ public:
         block = other.block;
         real_object = other.real_object;
         if (block != nullptr) {
-            ++block->weak_counter;
+            block->IncWeak();
         }
     };
 
@@ -28,7 +28,7 @@ public:
         block = other.block;
         real_object = other.real_object;
         if (block != nullptr) {
-            ++block->weak_counter;
+            block->IncWeak();
         }
     };
 
@@ -53,7 +53,7 @@ public:
         block = other.block;
         real_object = other.real_object;
         if (block != nullptr) {
-            ++block->weak_counter;
+            block->IncWeak();
         }
     };
 
@@ -65,7 +65,7 @@ public:
         block = other.block;
         real_object = other.real_object;
         if (block != nullptr) {
-            ++block->weak_counter;
+            block->IncWeak();
         }
         return *this;
     };
@@ -76,7 +76,7 @@ public:
         block = other.block;
         real_object = other.real_object;
         if (block != nullptr) {
-            ++block->weak_counter;
+            block->IncWeak();
         }
         return *this;
     };
@@ -104,24 +104,7 @@ public:
     // Destructor
 
     ~WeakPtr() {
-        if (block == nullptr) {
-            return;
-        }
-        if (block->weak_counter > 1) {
-            --block->weak_counter;
-            block = nullptr;
-            real_object = nullptr;
-        } else {
-            if (block->strong_counter == 0) {
-                delete block;
-                block = nullptr;
-                real_object = nullptr;
-            } else {
-                --block->weak_counter;
-                block = nullptr;
-                real_object = nullptr;
-            }
-        }
+        Reset();
     };
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -131,21 +114,9 @@ public:
         if (block == nullptr) {
             return;
         }
-        if (block->weak_counter > 1) {
-            --block->weak_counter;
-            block = nullptr;
-            real_object = nullptr;
-        } else {
-            if (block->strong_counter == 0) {
-                delete block;
-                block = nullptr;
-                real_object = nullptr;
-            } else {
-                --block->weak_counter;
-                block = nullptr;
-                real_object = nullptr;
-            }
-        }
+        block->ReleaseWeak();
+        block = nullptr;
+        real_object = nullptr;
     };
     void Swap(WeakPtr& other) {
         std::swap(block, other.block);
@@ -159,36 +130,37 @@ public:
         if (block == nullptr) {
             return 0;
         }
-        return block->strong_counter;
+        return block->StrongCount();
     };
 
     bool Expired() const {
         if (block == nullptr) {
             return true;
         }
-        if (block->strong_counter == 0) {
-            return true;
-        }
-        return false;
+        return block->StrongCount() == 0;
     };
 
-    SharedPtr<T> Lock() const {
+    // The strong count is only bumped if it is still nonzero, so a concurrent release of the last
+    // `SharedPtr` either happens before (and we return an empty pointer) or after (and we keep the
+    // object alive).
+    SharedPtr<T> Lock() const noexcept {
         SharedPtr<T> ans;
-        if (block == nullptr) {
-            ans.block = nullptr;
-            ans.real_object = nullptr;
-        } else if (block->strong_counter == 0) {
-            ans.block = nullptr;
-            ans.real_object = nullptr;
-        } else {
-            ans.block = block;
-            ans.real_object = real_object;
-            //--block->weak_counter;
-            ++block->strong_counter;
-        }
+        TryLock(ans);
         return ans;
     };
 
+    // Same as `Lock`, but tells an expired pointer apart from an empty one: returns false (and leaves
+    // `out` untouched) if there is no object to share.
+    bool TryLock(SharedPtr<T>& out) const noexcept {
+        if (block == nullptr || !block->TryIncStrong()) {
+            return false;
+        }
+        out.Reset();
+        out.block = block;
+        out.real_object = real_object;
+        return true;
+    };
+
     BaseBlock* block;
     T* real_object;
 };